@@ -0,0 +1,89 @@
+#include "BarGraph.h"
+#include "LCD.h"
+#include "Settings.h"
+
+#include <Arduino.h>
+
+namespace
+{
+// CGRAM slots 0..4 hold 1..5 filled pixel columns
+constexpr uint8_t firstGlyph = 0;
+bool glyphsLoaded = false;
+} // namespace
+
+BarGraph::BarGraph(uint8_t col, uint8_t row, uint8_t cells)
+    : col_(col)
+    , row_(row)
+    , cells_(cells)
+{
+}
+
+void BarGraph::loadGlyphs()
+{
+    uint8_t charmap[8];
+    for (int fill = 1; fill <= stepsPerCell; ++fill) {
+        uint8_t line = (0x1F << (stepsPerCell - fill)) & 0x1F;
+        for (auto& pixels : charmap) {
+            pixels = line;
+        }
+        lcd.createChar(firstGlyph + fill - 1, charmap);
+    }
+    glyphsLoaded = true;
+}
+
+int BarGraph::steps() const
+{
+    return cells_ * stepsPerCell;
+}
+
+bool BarGraph::stale() const
+{
+    return level_ < 0 || generation_ != lcd.generation();
+}
+
+void BarGraph::invalidate()
+{
+    level_ = -1;
+}
+
+void BarGraph::set(int level, int timeout)
+{
+    if (!settings.lcdEnabled || !lcd.ready()) {
+        invalidate();
+        return;
+    }
+    if (!glyphsLoaded) {
+        loadGlyphs();
+    }
+    level = constrain(level, 0, steps());
+
+    uint8_t first = 0;
+    uint8_t last = cells_;
+    if (!stale()) {
+        if (level == level_) {
+            return;
+        }
+        int low = level < level_ ? level : level_;
+        int high = level < level_ ? level_ : level;
+        first = low / stepsPerCell;
+        last = (high - 1) / stepsPerCell + 1;
+    }
+    level_ = level;
+
+    lcd.setCursor(col_ + first, row_);
+    for (uint8_t cell = first; cell < last; ++cell) {
+        drawCell(cell);
+    }
+    // Others see the change, the bar itself stays current
+    lcd.touch();
+    generation_ = lcd.generation();
+    if (timeout > 0) {
+        lcd.setTimeout(timeout);
+    }
+}
+
+void BarGraph::drawCell(uint8_t cell)
+{
+    int fill = constrain(level_ - cell * stepsPerCell, 0, stepsPerCell);
+    lcd.write(fill == 0 ? ' ' : firstGlyph + fill - 1);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <inttypes.h>
+
+// Horizontal bar drawn with partial-block glyphs, 5 steps per character cell.
+// Only the cells whose fill changed since the last call are rewritten.
+class BarGraph
+{
+public:
+    static constexpr int stepsPerCell = 5;
+
+    BarGraph(uint8_t col, uint8_t row, uint8_t cells);
+
+    void set(int level, int timeout = 1000);
+    int steps() const;
+    // True when the LCD was cleared or redrawn since the bar was last drawn
+    bool stale() const;
+    void invalidate();
+
+private:
+    static void loadGlyphs();
+    void drawCell(uint8_t cell);
+
+    uint8_t col_ = 0;
+    uint8_t row_ = 0;
+    uint8_t cells_ = 0;
+    int level_ = -1;
+    uint8_t generation_ = 0;
+};
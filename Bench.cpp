@@ -0,0 +1,172 @@
+#include "Bench.h"
+#include "Keyboard.h"
+#include "Keymap.h"
+#include "Input.h"
+#include "LCD.h"
+#include "Leds.h"
+#include "Hid.h"
+#include "Timers.h"
+
+#include <Arduino.h>
+
+namespace
+{
+// micros() ticks in 4 us steps, the repetitions make the averages exact to a few ns
+struct Case
+{
+    const char* name; // PROGMEM
+    void (*run)();
+    uint16_t reps;
+};
+
+volatile uint16_t sink;
+uint8_t counter = 0;
+
+void nothing()
+{
+}
+
+void scan()
+{
+    scanOnly();
+}
+
+void lcdWrite()
+{
+    lcd.write('0' + counter++ % 10);
+}
+
+void lcdClear()
+{
+    lcd.clear();
+}
+
+void ledShift()
+{
+    setLeds(counter++, 0);
+}
+
+void keymapLookup()
+{
+    sink = keymap::lookup(0, counter++ % keymap::keys);
+}
+
+void hidSend()
+{
+    hid::send();
+}
+
+void keyAction()
+{
+    input::execute({input::Matrix, 0, input::Tap, 0}, action::make(action::Key, KEY_F24));
+}
+
+const char overheadName[] PROGMEM = "call overhead";
+const char scanName[] PROGMEM = "matrix scan";
+const char lcdWriteName[] PROGMEM = "lcd write";
+const char lcdClearName[] PROGMEM = "lcd clear";
+const char ledsName[] PROGMEM = "led shift";
+const char keymapName[] PROGMEM = "keymap lookup";
+const char hidName[] PROGMEM = "hid report";
+const char actionName[] PROGMEM = "key action";
+
+// The first case measures the loop and the indirect call, the others subtract it
+const Case cases[] = {
+    {overheadName, &nothing, 1000},
+    {scanName, &scan, 200},
+    {lcdWriteName, &lcdWrite, 200},
+    {lcdClearName, &lcdClear, 20},
+    {ledsName, &ledShift, 200},
+    {keymapName, &keymapLookup, 1000},
+    {hidName, &hidSend, 20},
+    {actionName, &keyAction, 20},
+};
+constexpr uint8_t numCases = sizeof(cases) / sizeof(cases[0]);
+
+constexpr uint16_t pageTime = 2000;
+
+uint32_t nanos[numCases];
+uint8_t current = numCases;
+uint8_t page = numCases;
+timers::Handle benchTimer = timers::none;
+timers::Handle pageTimer = timers::none;
+
+uint32_t measure(const Case& c)
+{
+    uint32_t start = micros();
+    for (uint16_t i = 0; i < c.reps; ++i) {
+        c.run();
+    }
+    uint32_t total = (micros() - start) * 1000UL / c.reps;
+    if (&c != &cases[0]) {
+        total = total > nanos[0] ? total - nanos[0] : 0;
+    }
+    return total;
+}
+
+void showPage()
+{
+    if (page >= numCases) {
+        return;
+    }
+    auto name = reinterpret_cast<const __FlashStringHelper*>(cases[page].name);
+    uint32_t cycles = nanos[page] * (F_CPU / 1000000UL) / 1000;
+    lcd.cprint(name);
+    lcd.setCursor(0, 1);
+    lcd.print(nanos[page]);
+    lcd.print(F("ns "));
+    lcd.print(cycles);
+    lcd.print(F("cyc"), pageTime + 500);
+
+    // Skipped rather than waited for when the host isn't reading
+    if (Serial.availableForWrite() >= 48) {
+        Serial.print(F("bench "));
+        Serial.print(name);
+        Serial.print(' ');
+        Serial.print(nanos[page]);
+        Serial.print(F(" ns "));
+        Serial.print(cycles);
+        Serial.print(F(" cyc\n"));
+    }
+    if (++page < numCases) {
+        timers::start(pageTimer, pageTime);
+    }
+}
+
+void runCase()
+{
+    // Only the hid report case may reach the host, the key action types into the void
+    hid::mute(cases[current].run != &hidSend);
+    nanos[current] = measure(cases[current]);
+    hid::mute(false);
+    if (++current < numCases) {
+        timers::start(benchTimer, 1);
+        return;
+    }
+    refreshLeds();
+    page = 0;
+    showPage();
+}
+} // namespace
+
+void startBench()
+{
+    if (benchTimer == timers::none) {
+        benchTimer = timers::create(&runCase, F("bench"));
+        pageTimer = timers::create(&showPage, F("bench page"));
+    }
+    if (benchRunning()) {
+        return;
+    }
+    current = 0;
+    page = numCases;
+    timers::cancel(pageTimer);
+    lcd.cprint(F("Benchmark..."));
+    // Let the message reach the display before the LCD cases overwrite it
+    timers::start(benchTimer, 100);
+}
+
+bool benchRunning()
+{
+    return current < numCases;
+}
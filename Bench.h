@@ -0,0 +1,12 @@
+#pragma once
+
+// On-device microbenchmarks of the firmware's building blocks, started with Fn+13.
+// Each case runs back to back for a fixed number of repetitions, one case per timer
+// pass, so the board is busy for a few tens of ms at a time. The results are then shown
+// one per LCD page and printed on serial as "bench <name> <ns> ns <cycles> cyc".
+// Apart from the "hid report" case nothing reaches the host: the scan leaves its edges
+// queued and the key action runs with the reports muted.
+extern "C" {
+void startBench();
+bool benchRunning();
+}
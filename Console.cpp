@@ -0,0 +1,578 @@
+#include "Console.h"
+#include "Settings.h"
+#include "Keyboard.h"
+#include "Keymap.h"
+#include "IrCodes.h"
+#include "IR.h"
+#include "Health.h"
+#include "Storage.h"
+#include "LCD.h"
+#include "Leds.h"
+#include "Timers.h"
+#include "Trace.h"
+#include "Watchdog.h"
+#include "FrameSync.h"
+
+#include <Arduino.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+constexpr uint8_t maxBytesPerPoll = 16;
+// No further bytes are read after this, see Console.h for what a command may take
+constexpr uint16_t budgetMicros = 200;
+// Every reply is shorter than this, a reply is only produced when it fits
+constexpr uint8_t lineRoom = 80;
+
+char line[40];
+uint8_t lineLength = 0;
+bool lineReady = false;
+bool lineOverflow = false;
+
+// Replies wait here until the CDC endpoint has room
+class Reply : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        uint8_t next = (head_ + 1) % sizeof(buffer_);
+        if (next == tail_) {
+            return 0;
+        }
+        buffer_[head_] = c;
+        head_ = next;
+        return 1;
+    }
+    using Print::write;
+
+    uint8_t room() const
+    {
+        return sizeof(buffer_) - 1 - static_cast<uint8_t>(head_ - tail_) % sizeof(buffer_);
+    }
+
+    int read()
+    {
+        if (tail_ == head_) {
+            return -1;
+        }
+        uint8_t c = buffer_[tail_];
+        tail_ = (tail_ + 1) % sizeof(buffer_);
+        return c;
+    }
+
+private:
+    char buffer_[128];
+    uint8_t head_ = 0;
+    uint8_t tail_ = 0;
+};
+Reply reply;
+
+// The port is shared with the trace, whose lines are only let in between whole replies
+bool fromTrace = false;
+bool lineOpen = false;
+
+void drain()
+{
+    int space = Serial.availableForWrite();
+    while (space-- > 0) {
+        int c = fromTrace ? traceRead() : reply.read();
+        if (c < 0 && !lineOpen) {
+            fromTrace = !fromTrace;
+            c = fromTrace ? traceRead() : reply.read();
+        }
+        if (c < 0) {
+            break;
+        }
+        Serial.write(c);
+        lineOpen = c != '\n';
+    }
+}
+
+enum class Type : uint8_t { Bool, UInt };
+
+struct Field
+{
+    const char* name; // PROGMEM
+    Type type;
+    void* value;
+    void (*changed)();
+};
+
+const char keyboardName[] PROGMEM = "keyboard";
+const char echoName[] PROGMEM = "echo";
+const char irDebugName[] PROGMEM = "irdebug";
+const char ledsName[] PROGMEM = "leds";
+const char lcdName[] PROGMEM = "lcd";
+const char irName[] PROGMEM = "ir";
+const char randomLedsName[] PROGMEM = "randleds";
+const char traceName[] PROGMEM = "trace";
+const char idleName[] PROGMEM = "idle";
+const char debounceName[] PROGMEM = "debounce";
+const char tappingTermName[] PROGMEM = "tapterm";
+const char tapHoldModeName[] PROGMEM = "tapmode";
+const char encoderModeName[] PROGMEM = "encoder";
+const char encoderFnModeName[] PROGMEM = "encoderfn";
+const char stallBudgetName[] PROGMEM = "stall";
+const char scanSyncName[] PROGMEM = "sync";
+const char scanLeadName[] PROGMEM = "lead";
+
+const Field fields[] = {
+    {keyboardName, Type::Bool, &settings.keyboardEnabled, nullptr},
+    {echoName, Type::Bool, &settings.keyPressEcho, nullptr},
+    {irDebugName, Type::Bool, &settings.irDebug, nullptr},
+    {ledsName, Type::Bool, &settings.ledsEnabled, &refreshLeds},
+    {lcdName, Type::Bool, &settings.lcdEnabled,
+        [] {
+            if (!settings.lcdEnabled) {
+                lcd.clear();
+            }
+        }},
+    {irName, Type::Bool, &settings.irEnabled, nullptr},
+    {randomLedsName, Type::Bool, &settings.randomLeds, &refreshLeds},
+    {traceName, Type::Bool, &settings.traceRecord,
+        [] {
+            if (settings.traceRecord) {
+                startTrace();
+            }
+        }},
+    {idleName, Type::UInt, &settings.idleTimeout, nullptr},
+    {debounceName, Type::UInt, &settings.debounce, nullptr},
+    {tappingTermName, Type::UInt, &settings.tappingTerm, nullptr},
+    {tapHoldModeName, Type::UInt, &settings.tapHoldMode, nullptr},
+    {encoderModeName, Type::UInt, &settings.encoderMode, nullptr},
+    {encoderFnModeName, Type::UInt, &settings.encoderFnMode, nullptr},
+    {stallBudgetName, Type::UInt, &settings.stallBudget, nullptr},
+    {scanSyncName, Type::UInt, &settings.scanSync, nullptr},
+    {scanLeadName, Type::UInt, &settings.scanLead, nullptr},
+};
+constexpr uint8_t numFields = sizeof(fields) / sizeof(fields[0]);
+
+const char help0[] PROGMEM = "get [name], set name value, keymap,\n";
+const char help1[] PROGMEM = "map layer key action, ircodes [learn action|clear],\n";
+const char help2[] PROGMEM = "image begin|commit|default|read|ofs hex,\n";
+const char help3[] PROGMEM = "health [idx|reset], save, stalls,\n";
+const char help4[] PROGMEM = "prof, sof, trace on|off, bounce [type]\n";
+const char* const helpLines[] = {help0, help1, help2, help3, help4};
+
+// Multi-line replies are produced one line per free buffer slot
+enum class Dump : uint8_t { None, Help, Settings, Keymap, Health, Timers, IrCodes, Stalls };
+Dump dump = Dump::None;
+uint8_t dumpIndex = 0;
+
+const Field* findField(const char* name)
+{
+    for (const auto& field : fields) {
+        if (strcmp_P(name, field.name) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+void printField(const Field& field)
+{
+    reply.print(reinterpret_cast<const __FlashStringHelper*>(field.name));
+    reply.print(' ');
+    if (field.type == Type::Bool) {
+        reply.print(*static_cast<bool*>(field.value) ? 1 : 0);
+    } else {
+        reply.print(*static_cast<unsigned int*>(field.value));
+    }
+    reply.print('\n');
+}
+
+bool setField(const Field& field, const char* text)
+{
+    char* end = nullptr;
+    unsigned long value = 0;
+    if (strcmp_P(text, PSTR("on")) == 0) {
+        value = 1;
+    } else if (strcmp_P(text, PSTR("off")) != 0) {
+        value = strtoul(text, &end, 0);
+        if (*end != 0) {
+            return false;
+        }
+    }
+    if (field.type == Type::Bool) {
+        *static_cast<bool*>(field.value) = value != 0;
+    } else {
+        *static_cast<unsigned int*>(field.value) = value;
+    }
+    if (field.changed) {
+        field.changed();
+    }
+    return true;
+}
+
+void printBounceType()
+{
+    switch (lcd.getBounceType()) {
+        case LiquidCrystal::BounceType::Bounce:
+            reply.print(F("bounce\n"));
+            break;
+        case LiquidCrystal::BounceType::Loop:
+            reply.print(F("loop\n"));
+            break;
+        case LiquidCrystal::BounceType::None:
+            reply.print(F("none\n"));
+            break;
+    }
+}
+
+void dumpLine()
+{
+    switch (dump) {
+        case Dump::Help:
+            if (dumpIndex < sizeof(helpLines) / sizeof(helpLines[0])) {
+                reply.print(reinterpret_cast<const __FlashStringHelper*>(helpLines[dumpIndex++]));
+                return;
+            }
+            break;
+        case Dump::Settings:
+            if (dumpIndex < numFields) {
+                printField(fields[dumpIndex++]);
+                return;
+            }
+            break;
+        case Dump::Keymap:
+            if (dumpIndex < keyCount()) {
+                describeKey(dumpIndex++, reply);
+                return;
+            }
+            break;
+        case Dump::Health:
+            if (dumpIndex < keyCount()) {
+                printHealth(dumpIndex, keyHealth(dumpIndex), reply);
+                ++dumpIndex;
+                return;
+            }
+            break;
+        case Dump::Timers:
+            // Each dump covers the time since the previous one
+            if (dumpIndex < timers::count()) {
+                const auto& stats = timers::stats(dumpIndex);
+                auto name = timers::name(dumpIndex);
+                reply.print(name ? name : F("?"));
+                reply.print(F(" runs "));
+                reply.print(stats.runs);
+                reply.print(F(" avg "));
+                reply.print(stats.runs ? stats.totalMicros / stats.runs : 0);
+                reply.print(F(" max "));
+                reply.print(stats.maxMicros);
+                reply.print('\n');
+                ++dumpIndex;
+                return;
+            }
+            timers::resetStats();
+            break;
+        case Dump::IrCodes:
+            // Slot protocol address command action, empty slots are skipped
+            while (dumpIndex < ircodes::slots) {
+                ircodes::Code code;
+                uint16_t act;
+                if (ircodes::entry(dumpIndex++, code, act)) {
+                    reply.print(dumpIndex - 1);
+                    reply.print(' ');
+                    reply.print(code.protocol);
+                    reply.print(F(" 0x"));
+                    reply.print(code.address, HEX);
+                    reply.print(F(" 0x"));
+                    reply.print(code.command, HEX);
+                    reply.print(' ');
+                    action::print(act, reply);
+                    reply.print('\n');
+                    return;
+                }
+            }
+            break;
+        case Dump::Stalls:
+            // Latest first: ms since boot, timer, flash address, length in ms or "reset"
+            if (dumpIndex < watchdog::logSize) {
+                watchdog::Stall stall;
+                if (watchdog::entry(dumpIndex++, stall)) {
+                    auto name = timers::name(stall.timer);
+                    reply.print(stall.time);
+                    reply.print(' ');
+                    reply.print(name ? name : F("loop"));
+                    reply.print(F(" 0x"));
+                    reply.print(stall.pc, HEX);
+                    reply.print(' ');
+                    if (stall.reset) {
+                        reply.print(F("reset"));
+                    } else {
+                        reply.print(stall.length);
+                    }
+                    reply.print('\n');
+                }
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    reply.print(F("ok\n"));
+    dump = Dump::None;
+}
+
+// Since the previous "sof": frames, scans in step, late ones, scans with a report,
+// reports that made the next frame, scan end after the SOF in us
+void printFrameStats()
+{
+    const auto& stats = framesync::stats();
+    reply.print(F("frames "));
+    reply.print(stats.frames);
+    reply.print(F(" scans "));
+    reply.print(stats.scans);
+    reply.print(F(" late "));
+    reply.print(stats.late);
+    reply.print(F(" reports "));
+    reply.print(stats.reports);
+    reply.print(F(" made "));
+    reply.print(stats.made);
+    reply.print(F(" end avg "));
+    reply.print(stats.scans ? stats.sumFinish / stats.scans : 0);
+    reply.print(F(" max "));
+    reply.print(stats.maxFinish);
+    reply.print('\n');
+    framesync::resetStats();
+}
+
+void startDump(Dump what)
+{
+    dump = what;
+    dumpIndex = 0;
+}
+
+void printResult(bool ok)
+{
+    reply.print(ok ? F("ok\n") : F("err busy\n"));
+}
+
+// Actions are 16-bit numbers, "0x104a" for the keyboard usage 0x4a
+uint16_t parseNumber(const char* text)
+{
+    return strtoul(text, nullptr, 0);
+}
+
+// Pairs of hex digits into `data`, the number of bytes or -1 on a malformed string
+int parseHex(const char* text, uint8_t* data, uint8_t room)
+{
+    uint8_t length = 0;
+    while (text[0] != '\0') {
+        if (!isxdigit(text[0]) || !isxdigit(text[1]) || length == room) {
+            return -1;
+        }
+        char digits[3] = {text[0], text[1], '\0'};
+        data[length++] = strtoul(digits, nullptr, 16);
+        text += 2;
+    }
+    return length;
+}
+
+// image begin | <offset> <hex> | commit | default | read <offset>
+void image(const char* arg, const char* value)
+{
+    // What fits on one 40 character line after "image 123 "
+    constexpr uint8_t chunk = 14;
+    if (strcmp_P(arg, PSTR("begin")) == 0) {
+        printResult(keymap::beginImage());
+    } else if (strcmp_P(arg, PSTR("commit")) == 0) {
+        if (keymap::busy()) {
+            printResult(false);
+        } else if (!keymap::commitImage()) {
+            reply.print(F("err bad image\n"));
+        } else {
+            printResult(true);
+        }
+    } else if (strcmp_P(arg, PSTR("default")) == 0) {
+        printResult(keymap::restoreDefaults());
+    } else if (strcmp_P(arg, PSTR("read")) == 0) {
+        uint16_t offset = value ? parseNumber(value) : 0;
+        auto bytes = reinterpret_cast<const uint8_t*>(&keymap::live());
+        for (uint16_t i = offset; i < offset + chunk && i < sizeof(keymap::Image); ++i) {
+            if (bytes[i] < 0x10) {
+                reply.print('0');
+            }
+            reply.print(bytes[i], HEX);
+        }
+        reply.print('\n');
+    } else if (isdigit(arg[0]) && value != nullptr) {
+        uint8_t data[chunk];
+        int length = parseHex(value, data, sizeof(data));
+        if (length < 0 || !keymap::writeImage(parseNumber(arg), data, length)) {
+            reply.print(F("err bad write\n"));
+        } else {
+            reply.print(F("ok\n"));
+        }
+    } else {
+        reply.print(F("err usage: image begin|commit|default|read|<offset> <hex>\n"));
+    }
+}
+
+void execute()
+{
+    char* command = strtok(line, " ");
+    char* arg = strtok(nullptr, " ");
+    char* value = strtok(nullptr, " ");
+    char* extra = strtok(nullptr, " ");
+    if (command == nullptr) {
+        return;
+    }
+    if (strcmp_P(command, PSTR("help")) == 0) {
+        startDump(Dump::Help);
+    } else if (strcmp_P(command, PSTR("get")) == 0) {
+        if (arg == nullptr) {
+            startDump(Dump::Settings);
+        } else if (auto field = findField(arg)) {
+            printField(*field);
+        } else {
+            reply.print(F("err unknown setting\n"));
+        }
+    } else if (strcmp_P(command, PSTR("set")) == 0) {
+        auto field = arg ? findField(arg) : nullptr;
+        if (field == nullptr || value == nullptr) {
+            reply.print(F("err usage: set name value\n"));
+        } else if (!setField(*field, value)) {
+            reply.print(F("err bad value\n"));
+        } else {
+            printField(*field);
+        }
+    } else if (strcmp_P(command, PSTR("keymap")) == 0) {
+        if (arg == nullptr) {
+            startDump(Dump::Keymap);
+        } else {
+            int idx = atoi(arg);
+            if (idx >= 0 && idx < keyCount()) {
+                describeKey(idx, reply);
+            } else {
+                reply.print(F("err no such key\n"));
+            }
+        }
+    } else if (strcmp_P(command, PSTR("map")) == 0) {
+        if (extra == nullptr) {
+            reply.print(F("err usage: map layer key action\n"));
+        } else {
+            int layer = atoi(arg);
+            int idx = atoi(value);
+            if (layer < 0 || layer >= keymap::layers || idx < 0 || idx >= keymap::keys) {
+                reply.print(F("err no such key\n"));
+            } else {
+                printResult(keymap::set(layer, idx, parseNumber(extra)));
+            }
+        }
+    } else if (strcmp_P(command, PSTR("ircodes")) == 0) {
+        if (arg == nullptr) {
+            startDump(Dump::IrCodes);
+        } else if (strcmp_P(arg, PSTR("learn")) == 0 && value != nullptr) {
+            // Bound to the next remote button received
+            learnIr(parseNumber(value));
+            reply.print(F("ok\n"));
+        } else if (strcmp_P(arg, PSTR("clear")) == 0) {
+            printResult(ircodes::clear());
+        } else {
+            reply.print(F("err usage: ircodes [learn action|clear]\n"));
+        }
+    } else if (strcmp_P(command, PSTR("image")) == 0) {
+        if (arg == nullptr) {
+            reply.print(F("err usage: image begin|commit|default|read|<offset> <hex>\n"));
+        } else {
+            image(arg, value);
+        }
+    } else if (strcmp_P(command, PSTR("health")) == 0) {
+        if (arg == nullptr) {
+            startDump(Dump::Health);
+        } else if (strcmp_P(arg, PSTR("reset")) == 0) {
+            resetHealth();
+            reply.print(F("ok\n"));
+        } else {
+            int idx = atoi(arg);
+            if (idx >= 0 && idx < keyCount()) {
+                printHealth(idx, keyHealth(idx), reply);
+            } else {
+                reply.print(F("err no such key\n"));
+            }
+        }
+    } else if (strcmp_P(command, PSTR("save")) == 0) {
+        // Written in the background by pollStorage()
+        saveSettings();
+        reply.print(F("ok\n"));
+    } else if (strcmp_P(command, PSTR("prof")) == 0) {
+        startDump(Dump::Timers);
+    } else if (strcmp_P(command, PSTR("stalls")) == 0) {
+        startDump(Dump::Stalls);
+    } else if (strcmp_P(command, PSTR("sof")) == 0) {
+        printFrameStats();
+    } else if (strcmp_P(command, PSTR("trace")) == 0) {
+        // The trace shares the serial port, its lines go out between the replies
+        if (arg == nullptr || !setField(*findField("trace"), arg)) {
+            reply.print(F("err usage: trace on|off\n"));
+        } else {
+            reply.print(F("ok\n"));
+        }
+    } else if (strcmp_P(command, PSTR("bounce")) == 0) {
+        if (arg == nullptr) {
+            printBounceType();
+        } else if (strcmp_P(arg, PSTR("bounce")) == 0) {
+            lcd.setBounceType(LiquidCrystal::BounceType::Bounce);
+            printBounceType();
+        } else if (strcmp_P(arg, PSTR("loop")) == 0) {
+            lcd.setBounceType(LiquidCrystal::BounceType::Loop);
+            printBounceType();
+        } else if (strcmp_P(arg, PSTR("none")) == 0) {
+            lcd.setBounceType(LiquidCrystal::BounceType::None);
+            printBounceType();
+        } else {
+            reply.print(F("err usage: bounce bounce|loop|none\n"));
+        }
+    } else {
+        reply.print(F("err unknown command\n"));
+    }
+}
+} // namespace
+
+void setupConsole()
+{
+    Serial.begin(115200);
+}
+
+void pollConsole()
+{
+    uint32_t start = micros();
+    drain();
+    for (uint8_t i = 0; i < maxBytesPerPoll && micros() - start < budgetMicros; ++i) {
+        if (dump != Dump::None || lineReady) {
+            if (reply.room() < lineRoom) {
+                break;
+            }
+            if (dump != Dump::None) {
+                dumpLine();
+            } else {
+                execute();
+                lineReady = false;
+                lineLength = 0;
+            }
+            continue;
+        }
+        int c = Serial.read();
+        if (c < 0) {
+            break;
+        }
+        if (c == '\r' || c == '\n') {
+            if (lineOverflow) {
+                reply.print(F("err line too long\n"));
+                lineOverflow = false;
+                lineLength = 0;
+            } else if (lineLength > 0) {
+                line[lineLength] = 0;
+                lineReady = true;
+            }
+        } else if (lineLength < sizeof(line) - 1) {
+            line[lineLength++] = c;
+        } else {
+            lineOverflow = true;
+        }
+    }
+    drain();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Line oriented command console on the CDC serial port. Type 'help' for the commands.
+// pollConsole() reads a few bytes per call and only answers when the whole reply line
+// fits into its output buffer, so it never waits for the host and never drops output.
+// It stops taking bytes after 200 us, but a command that has started runs to its end. The
+// commands leave EEPROM writes and LCD redraws to the timers and state machines that own
+// them. Only "set lcd off" clears the display in place (2 ms), like the Fn toggle does.
+extern "C" {
+void setupConsole();
+void pollConsole();
+}
@@ -0,0 +1,137 @@
+#include "Diag.h"
+#include "Keyboard.h"
+#include "IR.h"
+#include "LCD.h"
+#include "Timers.h"
+
+#include <Arduino.h>
+
+namespace diag
+{
+uint16_t counters[NumCounters];
+} // namespace diag
+
+namespace
+{
+constexpr uint8_t numPages = 3;
+constexpr uint8_t width = 16;
+constexpr uint16_t refreshInterval = 1000;
+
+uint8_t page = numPages; // numPages: off
+timers::Handle refreshTimer = timers::none;
+uint32_t worstLoop = 0;
+
+// What the display holds, 0 marks a cell that has to be written
+char shadow[2][width];
+uint8_t generation = 0;
+
+int freeRam()
+{
+#ifdef __AVR__
+    extern int __heap_start, *__brkval;
+    int top;
+    return reinterpret_cast<int>(&top) -
+           reinterpret_cast<int>(__brkval ? __brkval : &__heap_start);
+#else
+    return 0;
+#endif
+}
+
+// Writes the changed runs of a row, padding it with spaces
+void drawRow(uint8_t row, const char* text)
+{
+    char next[width];
+    uint8_t len = strlen(text);
+    for (uint8_t col = 0; col < width; ++col) {
+        next[col] = col < len ? text[col] : ' ';
+    }
+    for (uint8_t col = 0; col < width;) {
+        if (next[col] == shadow[row][col]) {
+            ++col;
+            continue;
+        }
+        lcd.setCursor(col, row);
+        for (; col < width && next[col] != shadow[row][col]; ++col) {
+            lcd.write(next[col]);
+            shadow[row][col] = next[col];
+        }
+    }
+}
+
+void refresh()
+{
+    uint16_t counts[diag::NumCounters];
+    memcpy(counts, diag::counters, sizeof(counts));
+    memset(diag::counters, 0, sizeof(diag::counters));
+    uint32_t loop = worstLoop;
+    worstLoop = 0;
+
+    if (!settings.lcdEnabled || !lcd.ready()) {
+        return;
+    }
+    // Someone else wrote to the display as a whole
+    if (generation != lcd.generation()) {
+        memset(shadow, 0, sizeof(shadow));
+        generation = lcd.generation();
+    }
+    char upper[width + 1];
+    char lower[width + 1];
+    switch (page) {
+        case 0:
+            snprintf_P(upper, sizeof(upper), PSTR("Scan/s %u"), counts[diag::Scans]);
+            // Five digits fit the row, longer passes show as 99999
+            snprintf_P(lower, sizeof(lower), PSTR("Loop max %luus"),
+                static_cast<unsigned long>(loop > 99999 ? 99999 : loop));
+            break;
+        case 1:
+            snprintf_P(upper, sizeof(upper), PSTR("Queue hw %u"), keyQueueHighWater());
+            snprintf_P(lower, sizeof(lower), PSTR("Free RAM %d"), freeRam());
+            break;
+        default: {
+            // A frame takes at least 11 ms, so two digits hold any real rate
+            uint16_t frames = counts[diag::IrFrames];
+            uint16_t lost = irDropped();
+            snprintf_P(upper, sizeof(upper), PSTR("IR/s %u lost %u"), frames > 99 ? 99 : frames,
+                lost > 999 ? 999 : lost);
+            snprintf_P(lower, sizeof(lower), PSTR("HID/s %u"), counts[diag::HidReports]);
+            break;
+        }
+    }
+    drawRow(0, upper);
+    drawRow(1, lower);
+    // Keeps the persistent strings from coming back while the page is up
+    lcd.setTimeout(refreshInterval + 500);
+}
+} // namespace
+
+namespace diag
+{
+void loopTime(uint32_t micros)
+{
+    if (micros > worstLoop) {
+        worstLoop = micros;
+    }
+}
+
+void nextPage()
+{
+    if (refreshTimer == timers::none) {
+        refreshTimer = timers::create(&refresh, F("diag"));
+    }
+    page = page < numPages ? page + 1 : 0;
+    if (page == numPages) {
+        timers::cancel(refreshTimer);
+        lcd.cprint(F("Diagnostics: OFF"));
+        return;
+    }
+    // Start the page on a clean window
+    memset(counters, 0, sizeof(counters));
+    worstLoop = 0;
+    keyQueueHighWater();
+    lcd.clear();
+    memset(shadow, 0, sizeof(shadow));
+    generation = lcd.generation();
+    lcd.setTimeout(refreshInterval + 500);
+    timers::every(refreshTimer, refreshInterval);
+}
+} // namespace diag
@@ -0,0 +1,22 @@
+#pragma once
+#include <inttypes.h>
+
+// Live diagnostics pages on the LCD, cycled with Fn+14. Counts are taken over one second
+// windows and the page is redrawn once per window, writing only the characters that
+// changed, so watching the numbers barely moves them.
+namespace diag
+{
+enum Counter : uint8_t { Scans, IrFrames, HidReports, NumCounters };
+
+extern uint16_t counters[NumCounters];
+
+inline void count(Counter counter, uint16_t n = 1)
+{
+    counters[counter] += n;
+}
+
+// Time one loop pass spent running timers
+void loopTime(uint32_t micros);
+// Off, then each page in turn, then off again
+void nextPage();
+} // namespace diag
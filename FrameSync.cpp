@@ -0,0 +1,100 @@
+#include "FrameSync.h"
+#include "Keyboard.h"
+#include "Settings.h"
+#include "Hid.h"
+#include "Diag.h"
+
+#include <Arduino.h>
+
+namespace
+{
+constexpr uint16_t framePeriod = 1000; // us
+// Without a SOF for this long the bus is considered idle and the timer takes over
+constexpr uint16_t sofTimeout = 3000;
+
+uint8_t frame = 0;
+uint32_t sofTime = 0;
+// A frame number has been seen, before that there is no previous frame to have missed
+bool counting = false;
+bool scanned = true;
+framesync::Stats counts;
+
+bool synced()
+{
+    return settings.scanSync && micros() - sofTime < sofTimeout;
+}
+
+void scan()
+{
+    uint16_t reports = diag::counters[diag::HidReports];
+    readMatrix();
+    uint32_t finish = micros() - sofTime;
+    ++counts.scans;
+    if (diag::counters[diag::HidReports] != reports) {
+        ++counts.reports;
+        if (hid::frame() == frame) {
+            ++counts.made;
+        }
+    }
+    counts.sumFinish += finish;
+    if (finish > counts.maxFinish) {
+        counts.maxFinish = finish > 0xFFFF ? 0xFFFF : finish;
+    }
+}
+} // namespace
+
+namespace framesync
+{
+// The time of a SOF is that of the pass that sees the new frame number, so a long
+// timer callback makes the scan of that frame late. When passes run longer than the
+// time from the SOF to the scan point, the next frame comes before any pass gets
+// there, so a frame that ended without its scan has it at the start of the next one.
+void poll()
+{
+    uint32_t now = micros();
+    uint8_t current = hid::frame();
+    bool missed = false;
+    if (current != frame) {
+        // After a gap in the SOFs the matrix timer did the scanning
+        missed = counting && now - sofTime < sofTimeout &&
+                 (!scanned || static_cast<uint8_t>(current - frame) > 1);
+        counting = true;
+        frame = current;
+        sofTime = now;
+        scanned = false;
+        ++counts.frames;
+    }
+    if (!settings.scanSync) {
+        return;
+    }
+    if (missed) {
+        // For the frame that went by, this one still gets its own
+        ++counts.late;
+        scan();
+        return;
+    }
+    uint16_t start = settings.scanLead < framePeriod ? framePeriod - settings.scanLead : 0;
+    if (scanned || now - sofTime < start) {
+        return;
+    }
+    scanned = true;
+    scan();
+}
+
+void timedScan()
+{
+    if (!synced()) {
+        readMatrix();
+    }
+}
+
+const Stats& stats()
+{
+    return counts;
+}
+
+void resetStats()
+{
+    counts = {};
+}
+} // namespace framesync
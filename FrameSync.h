@@ -0,0 +1,30 @@
+#pragma once
+#include <inttypes.h>
+
+// Matrix scans in step with the host's USB frames. The core's USB interrupt already owns
+// the start of frame (SOF) interrupt, so poll() watches the frame number from the loop
+// and takes the time of each new frame instead. With settings.scanSync on, the scan
+// runs once per frame, settings.scanLead us before the next SOF, so a report it sends
+// is in the endpoint when the host polls early in the next frame. While there are no
+// SOFs, with the bus suspended or not yet configured, the matrix timer scans as before.
+namespace framesync
+{
+// Since the previous resetStats()
+struct Stats
+{
+    uint16_t frames;     // SOFs seen
+    uint16_t scans;      // scans run in step
+    uint16_t late;       // of those, scans run at the SOF because a frame went by without one
+    uint16_t reports;    // of those, scans that sent a report
+    uint16_t made;       // of those, reports queued before the next SOF
+    uint16_t maxFinish;  // latest end of a scan, us after its SOF
+    uint32_t sumFinish;
+};
+
+// Every loop pass
+void poll();
+// The 1 ms matrix timer, scans unless poll() does
+void timedScan();
+const Stats& stats();
+void resetStats();
+} // namespace framesync
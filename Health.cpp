@@ -0,0 +1,34 @@
+#include "Health.h"
+
+#include <Arduino.h>
+
+namespace
+{
+void printInterval(uint16_t ms, Print& out)
+{
+    if (ms == KeyHealth::none) {
+        out.print('-');
+    } else {
+        out.print(ms);
+    }
+}
+} // namespace
+
+void printHealth(int idx, const KeyHealth& health, Print& out)
+{
+    out.print(idx);
+    out.print(F(" p "));
+    out.print(health.presses);
+    out.print(F(" r "));
+    out.print(health.rejected);
+    out.print(F(" min "));
+    printInterval(health.shortestPress, out);
+    out.print('/');
+    printInterval(health.shortestRelease, out);
+    out.print(F(" b"));
+    for (auto count : health.bounce) {
+        out.print(' ');
+        out.print(count);
+    }
+    out.print('\n');
+}
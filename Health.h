@@ -0,0 +1,62 @@
+#pragma once
+#include <inttypes.h>
+
+class Print;
+
+// Per-key switch statistics, updated by the debouncer on every edge. All counters
+// saturate instead of wrapping and nothing here divides, so it is cheap enough for the
+// scan path. The table is saved together with the settings.
+struct KeyHealth
+{
+    static constexpr uint8_t bounceBuckets = 4;
+    static constexpr uint16_t none = 0xFFFF;
+
+    uint16_t presses = 0;
+    // Edges that arrived inside the debounce window and were dropped
+    uint16_t rejected = 0;
+    // Shortest accepted press (down to up) and release (up to down) in ms
+    uint16_t shortestPress = none;
+    uint16_t shortestRelease = none;
+    // Bounce bursts by width: 0-1, 2-3, 4-7 and 8+ ms after the accepted edge
+    uint8_t bounce[bounceBuckets] = {};
+
+    template <typename T>
+    static void increment(T& counter)
+    {
+        if (counter != static_cast<T>(~T(0))) {
+            ++counter;
+        }
+    }
+
+    void pressed(uint32_t sinceRelease)
+    {
+        increment(presses);
+        shorten(shortestRelease, sinceRelease);
+    }
+
+    void released(uint32_t heldFor)
+    {
+        shorten(shortestPress, heldFor);
+    }
+
+    // `width` is the time from the accepted edge to the last rejected one
+    void bounced(uint8_t width)
+    {
+        uint8_t bucket = 0;
+        for (width >>= 1; width && bucket < bounceBuckets - 1; width >>= 1) {
+            ++bucket;
+        }
+        increment(bounce[bucket]);
+    }
+
+private:
+    static void shorten(uint16_t& shortest, uint32_t interval)
+    {
+        if (interval < shortest) {
+            shortest = interval;
+        }
+    }
+};
+
+// One line: "<idx> p <presses> r <rejected> min <press>/<release> b <buckets...>"
+void printHealth(int idx, const KeyHealth& health, Print& out);
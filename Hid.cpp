@@ -0,0 +1,181 @@
+#include "Hid.h"
+#include "Diag.h"
+
+namespace
+{
+hid::LedsCallback ledsCallback = nullptr;
+uint8_t lastLeds = 0;
+hid::SuspendCallback suspendCallback = nullptr;
+bool wasSuspended = false;
+bool muted = false;
+
+// After HID-Project's own report IDs
+constexpr uint8_t scrollReportId = 11;
+
+// A mouse that only has a wheel and AC Pan
+const uint8_t scrollDescriptor[] PROGMEM = {
+    0x05, 0x01,       // Usage Page (Generic Desktop)
+    0x09, 0x02,       // Usage (Mouse)
+    0xA1, 0x01,       // Collection (Application)
+    0x85, scrollReportId, //   Report ID
+    0x09, 0x01,       //   Usage (Pointer)
+    0xA1, 0x00,       //   Collection (Physical)
+    0x09, 0x38,       //     Usage (Wheel)
+    0x15, 0x81,       //     Logical Minimum (-127)
+    0x25, 0x7F,       //     Logical Maximum (127)
+    0x75, 0x08,       //     Report Size (8)
+    0x95, 0x01,       //     Report Count (1)
+    0x81, 0x06,       //     Input (Data, Variable, Relative)
+    0x05, 0x0C,       //     Usage Page (Consumer)
+    0x0A, 0x38, 0x02, //     Usage (AC Pan)
+    0x81, 0x06,       //     Input (Data, Variable, Relative)
+    0xC0,             //   End Collection
+    0xC0,             // End Collection
+};
+HIDSubDescriptor scrollNode(scrollDescriptor, sizeof(scrollDescriptor));
+} // namespace
+
+namespace hid
+{
+void begin()
+{
+    Keyboard.begin();
+    Consumer.begin();
+    BootKeyboard.begin();
+    HID().AppendDescriptor(&scrollNode);
+}
+
+void press(KeyboardKeycode key)
+{
+    if (muted) {
+        Keyboard.add(key);
+        return;
+    }
+    diag::count(diag::HidReports);
+    Keyboard.press(key);
+}
+
+void release(KeyboardKeycode key)
+{
+    if (muted) {
+        Keyboard.remove(key);
+        return;
+    }
+    diag::count(diag::HidReports);
+    Keyboard.release(key);
+}
+
+void write(KeyboardKeycode key)
+{
+    if (muted) {
+        return;
+    }
+    // Press and release
+    diag::count(diag::HidReports, 2);
+    Keyboard.write(key);
+}
+
+void print(const __FlashStringHelper* text)
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports, 2 * strlen_P(reinterpret_cast<const char*>(text)));
+    Keyboard.print(text);
+}
+
+void send()
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports);
+    Keyboard.send();
+}
+
+void press(ConsumerKeycode key)
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports);
+    Consumer.press(key);
+}
+
+void release(ConsumerKeycode key)
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports);
+    Consumer.release(key);
+}
+
+void write(ConsumerKeycode key)
+{
+    if (muted) {
+        return;
+    }
+    // Press and release
+    diag::count(diag::HidReports, 2);
+    Consumer.write(key);
+}
+
+void scroll(int8_t wheel, int8_t pan)
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports);
+    int8_t report[] = {wheel, pan};
+    HID().SendReport(scrollReportId, report, sizeof(report));
+}
+
+void mute(bool on)
+{
+    muted = on;
+}
+
+uint8_t frame()
+{
+    return UDFNUML;
+}
+
+void onLeds(LedsCallback callback)
+{
+    ledsCallback = callback;
+}
+
+void onSuspend(SuspendCallback callback)
+{
+    suspendCallback = callback;
+}
+
+bool suspended()
+{
+    return USBDevice.isSuspended();
+}
+
+bool wakeup()
+{
+    return USBDevice.wakeupHost();
+}
+
+void poll()
+{
+    bool suspended = USBDevice.isSuspended();
+    if (suspended != wasSuspended) {
+        wasSuspended = suspended;
+        if (suspendCallback) {
+            suspendCallback(suspended);
+        }
+    }
+    uint8_t leds = BootKeyboard.getLeds();
+    if (leds != lastLeds) {
+        lastLeds = leds;
+        if (ledsCallback) {
+            ledsCallback(leds);
+        }
+    }
+}
+} // namespace hid
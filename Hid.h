@@ -0,0 +1,44 @@
+#pragma once
+#include <HID-Project.h>
+
+// Every HID report the firmware sends goes through here. On the board this is
+// HID-Project (Hid.cpp), the host builds link host/HidSink.cpp instead, which records
+// the reports against simulated USB frames.
+namespace hid
+{
+void begin();
+
+void press(KeyboardKeycode key);
+void release(KeyboardKeycode key);
+void write(KeyboardKeycode key);
+void print(const __FlashStringHelper* text);
+// Sends the current keyboard report again
+void send();
+// While muted the keyboard report still follows press() and release(), but no report of
+// any kind goes to the host. The on-device bench times the key path with it.
+void mute(bool on);
+
+void press(ConsumerKeycode key);
+void release(ConsumerKeycode key);
+void write(ConsumerKeycode key);
+
+// Wheel and horizontal pan in detents, positive is up and right
+void scroll(int8_t wheel, int8_t pan);
+
+// Low byte of the USB frame number, one count per start of frame from the host
+uint8_t frame();
+
+typedef void (*LedsCallback)(uint8_t leds);
+// Called with the new lock LED byte whenever the host changes it
+void onLeds(LedsCallback callback);
+typedef void (*SuspendCallback)(bool suspended);
+// Called when the host suspends the bus and when it resumes it
+void onSuspend(SuspendCallback callback);
+bool suspended();
+// Signals remote wakeup to a suspended host. False when the host has not enabled it.
+bool wakeup();
+
+// HID-Project stores the host's output report without telling anyone, and the core only
+// keeps the suspend state in a flag. This compares both with what the callbacks saw last.
+void poll();
+} // namespace hid
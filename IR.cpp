@@ -4,29 +4,54 @@
 #include "LCD.h"
 #include "Leds.h"
 #include "Settings.h"
+#include "Trace.h"
+#include "Hid.h"
+#include "Diag.h"
+#include "Keymap.h"
+#include "IrCodes.h"
+#include "Input.h"
+#include "Tick.h"
+#include "IrCapture.h"
 
+// Builds with -DIR_IRREMOTE receive through IRremote and its 50 us sampling interrupt
+// instead of the pin change front end in IrCapture.cpp
+#ifdef IR_IRREMOTE
 #include <IRremote.h>
-#include <ArduinoSTL.h>
-#include <MultiReport/ImprovedKeyboard.h>
-#include <MultiReport/Consumer.h>
-#include <map>
+#endif
 
 namespace
 {
+#ifdef IR_IRREMOTE
 namespace pins
 {
 const int ir = 16;
 }
 
-std::map<int, ConsumerKeycode> irConsumerMapping = {{0x45, MEDIA_VOL_MUTE}, {0x44, MEDIA_PREVIOUS},
-    {0x40, MEDIA_PLAY_PAUSE}, {0x43, MEDIA_NEXT}};
-
-std::map<int, KeyboardKeycode> irKeyboardMapping = {{0x7, KEY_LEFT_ARROW}, {0x9, KEY_RIGHT_ARROW}};
+bool receive(ircapture::Frame& frame)
+{
+    if (!IrReceiver.decode()) {
+        return false;
+    }
+    const auto& data = IrReceiver.decodedIRData;
+    frame = {static_cast<uint8_t>(data.protocol), data.address, data.command,
+        (data.flags & IRDATA_FLAGS_IS_REPEAT) != 0};
+    IrReceiver.resume();
+    return true;
+}
+#else
+bool receive(ircapture::Frame& frame)
+{
+    return ircapture::decode(frame);
+}
+#endif
 
-decode_results results;
 uint16_t lastCommand = 0;
 uint16_t commandRepeat = 0;
 
+enum class Learning : uint8_t { Off, Key, Button };
+Learning learning = Learning::Off;
+uint16_t learnedAction = 0;
+
 struct IrGuard
 {
 public:
@@ -36,18 +61,76 @@ public:
     }
     ~IrGuard()
     {
-        IrReceiver.resume();
         lastCommand = command_;
     }
 
 private:
     uint16_t command_ = 0;
 };
+
+bool continuous(uint16_t act)
+{
+    return action::tag(act) == action::Command &&
+           (action::value(act) == action::VolumeUp || action::value(act) == action::VolumeDown);
+}
+
+void learnButton(const ircapture::Frame& data)
+{
+    learning = Learning::Off;
+    if (ircodes::learn({data.protocol, data.address, data.command}, learnedAction)) {
+        lcd.cprint(F("Learned "));
+        lcd.print(data.command, HEX);
+    } else {
+        lcd.cprint(F("Learn failed"));
+    }
+}
 } // namespace
 
+void startIrLearning()
+{
+    learning = Learning::Key;
+    lcd.cprint(F("Learn: press key"));
+}
+
+void stopIrLearning()
+{
+    learning = Learning::Off;
+    lcd.cprint(F("Learn: off"));
+}
+
+bool irLearning()
+{
+    return learning != Learning::Off;
+}
+
+bool irLearningWantsKey()
+{
+    return learning == Learning::Key;
+}
+
+void learnIr(uint16_t action)
+{
+    learnedAction = action;
+    learning = Learning::Button;
+    lcd.cprint(F("Learn: press IR"));
+}
+
+uint16_t irDropped()
+{
+#ifdef IR_IRREMOTE
+    return 0;
+#else
+    return ircapture::overruns();
+#endif
+}
+
 void setupIR()
 {
+#ifdef IR_IRREMOTE
     IrReceiver.begin(pins::ir, ENABLE_LED_FEEDBACK);
+#else
+    ircapture::begin();
+#endif
 }
 
 void checkIR()
@@ -57,12 +140,22 @@ void checkIR()
     }
     constexpr int continuousThreshold = 1;
     constexpr int singleThreshold = 2;
-    if (!IrReceiver.decode()) {
+    ircapture::Frame data;
+    if (!receive(data)) {
         return;
     }
-    const auto& data = IrReceiver.decodedIRData;
+    diag::count(diag::IrFrames);
     IrGuard guard(data.command);
-    bool repeat = data.flags & IRDATA_FLAGS_IS_REPEAT;
+    // Nothing can be sent to a suspended host
+    if (hid::suspended()) {
+        return;
+    }
+    bool repeat = data.repeat;
+    traceIr(data.address, data.command, repeat ? ircapture::repeatFlag : 0);
+    if (learning == Learning::Button && !repeat) {
+        learnButton(data);
+        return;
+    }
     out::cout << out::hex << data.command << F(" ") << lastCommand << F(" ") << out::dec
               << commandRepeat << F(" ") << repeat << out::endl;
 
@@ -80,26 +173,18 @@ void checkIR()
         lcd.print(data.command, HEX);
         lcd.setCursor(9, 0);
         lcd.print(repeat);
+        lcd.touch();
     }
     ++commandRepeat;
-    if (commandRepeat >= continuousThreshold) {
-        out ::cout << F("Continuous") << out::endl;
-        switch (data.command) {
-            case 0x46:
-                addTargetVolume(0.02);
-                break;
-            case 0x15:
-                addTargetVolume(-0.02);
-                break;
+    uint16_t act = ircodes::lookup({data.protocol, data.address, data.command});
+    input::Event event = {input::Ir, static_cast<uint8_t>(data.command), input::Tap, tick::now()};
+    if (continuous(act)) {
+        if (commandRepeat >= continuousThreshold) {
+            out ::cout << F("Continuous") << out::endl;
+            input::execute(event, act);
         }
-    }
-    if (commandRepeat == singleThreshold) {
+    } else if (commandRepeat == singleThreshold) {
         out::cout << F("Single") << out::endl;
-        if (irConsumerMapping.count(data.command) > 0) {
-            setLedAnimation({129, 66, 36, 24, 36, 66, 129, 0}, 7, 200);
-            Consumer.write(irConsumerMapping[data.command]);
-        } else if (irKeyboardMapping.count(data.command) > 0) {
-            Keyboard.write(irKeyboardMapping[data.command]);
-        }
+        input::execute(event, act);
     }
 }
\ No newline at end of file
@@ -1,6 +1,19 @@
 #pragma once
+#include <inttypes.h>
 
 extern "C" {
 void setupIR();
 void checkIR();
-}
\ No newline at end of file
+}
+
+// Learning binds a remote button to an action: the next key press picks the action,
+// the next IR frame the button. The console can skip the key with learnIr().
+void startIrLearning();
+void stopIrLearning();
+bool irLearning();
+// True while learning waits for the key, its action goes to learnIr() instead
+bool irLearningWantsKey();
+void learnIr(uint16_t action);
+
+// Frames the receiver front end had to drop since boot, always 0 with IRremote
+uint16_t irDropped();
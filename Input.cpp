@@ -0,0 +1,186 @@
+#include "Input.h"
+#include "Keymap.h"
+#include "Keyboard.h"
+#include "Out.h"
+#include "LCD.h"
+#include "Leds.h"
+#include "Settings.h"
+#include "Hid.h"
+#include "Trace.h"
+#include "Bench.h"
+#include "Diag.h"
+#include "IR.h"
+#include "Volume.h"
+
+#include <Arduino.h>
+
+namespace
+{
+uint8_t currentLayer = 0;
+// Scrolling executed since the last flush()
+int16_t wheel = 0;
+int16_t pan = 0;
+
+void mute()
+{
+    hid::write(MEDIA_VOL_MUTE);
+    setLedAnimation({1, 9, 73, 219, 255, 0, 0, 0}, 5, 100);
+}
+
+void show(const __FlashStringHelper* label, bool on)
+{
+    lcd.cprint(label);
+    lcd.print(on ? F("ON") : F("OFF"));
+}
+
+void toggle(bool& setting, const __FlashStringHelper* label)
+{
+    setting = !setting;
+    show(label, setting);
+}
+
+void runCommand(uint8_t command)
+{
+    switch (command) {
+        case action::Mute:
+            if (settings.keyboardEnabled) {
+                mute();
+            }
+            break;
+        case action::KeyEcho:
+            toggle(settings.keyPressEcho, F("Key echo: "));
+            break;
+        case action::IrDebug:
+            toggle(settings.irDebug, F("IR debug: "));
+            break;
+        case action::Leds:
+            toggle(settings.ledsEnabled, F("LEDs: "));
+            refreshLeds();
+            break;
+        case action::Lcd:
+            settings.lcdEnabled = !settings.lcdEnabled;
+            if (settings.lcdEnabled) {
+                lcd.cprint(F("LCD: ON"));
+            } else {
+                lcd.clear();
+            }
+            break;
+        case action::Ir:
+            toggle(settings.irEnabled, F("IR: "));
+            break;
+        case action::Bounce:
+            lcd.shiftBounceType();
+            lcd.cprint(F("Bounce: "));
+            switch (lcd.getBounceType()) {
+                case LiquidCrystal::BounceType::Bounce:
+                    lcd.print("Bounce");
+                    break;
+                case LiquidCrystal::BounceType::Loop:
+                    lcd.print("Loop");
+                    break;
+                case LiquidCrystal::BounceType::None:
+                    lcd.print("None");
+                    break;
+            }
+            break;
+        case action::Keyboard:
+            toggle(settings.keyboardEnabled, F("Keyboard: "));
+            break;
+        case action::RandomLeds:
+            toggle(settings.randomLeds, F("Rand LEDs: "));
+            refreshLeds();
+            break;
+        case action::Trace:
+            if (!settings.traceRecord) {
+                startTrace();
+            }
+            toggle(settings.traceRecord, F("Trace: "));
+            break;
+        case action::HealthPage:
+            show(F("Key health: "), toggleHealthPage());
+            break;
+        case action::Bench:
+            startBench();
+            break;
+        case action::Diagnostics:
+            diag::nextPage();
+            break;
+        case action::IrLearn:
+            if (irLearning()) {
+                stopIrLearning();
+            } else {
+                startIrLearning();
+            }
+            break;
+        case action::VolumeUp:
+            addTargetVolume(0.02);
+            break;
+        case action::VolumeDown:
+            addTargetVolume(-0.02);
+            break;
+    }
+}
+} // namespace
+
+namespace input
+{
+// Only releases are sent while the keyboard is off, so nothing it turned off stays held
+void execute(const Event& event, uint16_t act)
+{
+    auto value = action::value(act);
+    bool pressed = event.edge != Release;
+    bool send = pressed && settings.keyboardEnabled;
+    switch (action::tag(act)) {
+        case action::Key:
+            if (send) {
+                out::cout << F("Sending ") << value << out::endl;
+                hid::press(KeyboardKeycode(value));
+            }
+            if (event.edge != Press) {
+                hid::release(KeyboardKeycode(value));
+            }
+            break;
+        case action::Consumer:
+            if (send) {
+                // The remote has no other way to show that it was heard
+                if (event.source == Ir) {
+                    setLedAnimation({129, 66, 36, 24, 36, 66, 129, 0}, 7, 200);
+                }
+                hid::write(ConsumerKeycode(value));
+            }
+            break;
+        case action::Command:
+            if (pressed) {
+                runCommand(value);
+            }
+            break;
+        case action::Layer:
+            if (event.edge != Tap) {
+                currentLayer = pressed && value < keymap::layers ? value : 0;
+            }
+            break;
+        case action::Scroll:
+            if (send) {
+                (value >> 8 ? pan : wheel) += static_cast<int8_t>(value);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void flush()
+{
+    if (wheel == 0 && pan == 0) {
+        return;
+    }
+    hid::scroll(constrain(wheel, -127, 127), constrain(pan, -127, 127));
+    wheel = 0;
+    pan = 0;
+}
+
+uint8_t layer()
+{
+    return currentLayer;
+}
+} // namespace input
@@ -0,0 +1,32 @@
+#pragma once
+#include <inttypes.h>
+
+// The one way from an input to what it does. Matrix keys, IR buttons and encoder
+// detents each become an Event, their source looks up the action (keymap, IR code
+// table, encoder mode, see Keymap.h for actions) and execute() carries it out: the HID
+// reports, the layer, firmware commands and the LED feedback that goes with them.
+// Scrolling is summed up until flush() and sent as one report.
+namespace input
+{
+enum Source : uint8_t { Matrix, Ir, Encoder };
+
+enum Edge : uint8_t {
+    Press,   // held until the Release of the same source and id
+    Release,
+    Tap,     // press and release at once, for inputs that only report that they happened
+};
+
+struct Event
+{
+    Source source;
+    uint8_t id;    // key index, IR command, or 0 for encoder up and 1 for down
+    Edge edge;
+    uint32_t time; // tick::now() when the source saw it
+};
+
+void execute(const Event& event, uint16_t action);
+// Sends the scrolling executed since the previous call
+void flush();
+// Layer the held keys select, 0 when none
+uint8_t layer();
+} // namespace input
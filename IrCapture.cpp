@@ -0,0 +1,166 @@
+// Left out of builds with the IRremote backend, see IR.cpp
+#ifndef IR_IRREMOTE
+#include "IrCapture.h"
+#include "Profile.h"
+#include "Queue.h"
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace
+{
+// PB2, the only pin of PCINT0_vect that is unmasked
+constexpr uint8_t pin = 16;
+
+// Each interval between two edges: bit 15 is set for a mark (receiver output low), the
+// rest is its length in us, 0x7FFF for anything longer
+constexpr uint16_t markBit = 0x8000;
+constexpr uint16_t longest = 0x7FFF;
+uint32_t lastEdge = 0;
+
+// Decoded frames, filled by the interrupt. A repeat frame follows every 108 ms while a
+// button is held, so this covers loop passes of about 400 ms.
+Queue<ircapture::Frame, 4> frames;
+volatile uint16_t overrunCount = 0;
+
+typedef decltype(portInputRegister(0)) Register;
+Register input;
+uint8_t mask = 0;
+
+// NEC timing, with the margins IR receivers need: their marks come out longer and
+// their spaces shorter than sent
+bool near(uint16_t length, uint16_t nominal)
+{
+    return length > nominal - nominal / 4 - 100 && length < nominal + nominal / 4 + 100;
+}
+
+enum class State : uint8_t { Idle, LeaderSpace, BitMark, BitSpace, DataStop, RepeatStop };
+State state = State::Idle;
+uint32_t bits = 0;
+uint8_t bitCount = 0;
+bool haveLast = false;
+ircapture::Frame last;
+
+// The frame in `bits`, LSB first: address, inverted address or its high byte,
+// command, inverted command
+bool finish(ircapture::Frame& frame)
+{
+    uint8_t address = bits;
+    uint8_t addressHigh = bits >> 8;
+    uint8_t command = bits >> 16;
+    if (static_cast<uint8_t>(~command) != static_cast<uint8_t>(bits >> 24)) {
+        return false;
+    }
+    last.protocol = ircapture::nec;
+    last.address = addressHigh == static_cast<uint8_t>(~address)
+                       ? address
+                       : static_cast<uint16_t>(addressHigh) << 8 | address;
+    last.command = command;
+    last.repeat = false;
+    haveLast = true;
+    frame = last;
+    return true;
+}
+
+// Feeds one interval to the decoder, true when it completes a frame
+bool step(uint16_t entry, ircapture::Frame& frame)
+{
+    bool mark = entry & markBit;
+    uint16_t length = entry & longest;
+    switch (state) {
+        case State::Idle:
+            break;
+        case State::LeaderSpace:
+            if (!mark && near(length, 4500)) {
+                bits = 0;
+                bitCount = 0;
+                state = State::BitMark;
+                return false;
+            }
+            if (!mark && near(length, 2250)) {
+                state = State::RepeatStop;
+                return false;
+            }
+            break;
+        case State::BitMark:
+            if (mark && near(length, 560)) {
+                state = State::BitSpace;
+                return false;
+            }
+            break;
+        case State::BitSpace:
+            if (!mark && (near(length, 560) || near(length, 1690))) {
+                if (length > 1100) {
+                    bits |= 1UL << bitCount;
+                }
+                state = ++bitCount == 32 ? State::DataStop : State::BitMark;
+                return false;
+            }
+            break;
+        case State::DataStop:
+            if (mark && near(length, 560)) {
+                state = State::Idle;
+                return finish(frame);
+            }
+            break;
+        case State::RepeatStop:
+            if (mark && near(length, 560) && haveLast) {
+                state = State::Idle;
+                frame = last;
+                frame.repeat = true;
+                return true;
+            }
+            break;
+    }
+    // Out of step, the interval may still start the next frame
+    state = mark && near(length, 9000) ? State::LeaderSpace : State::Idle;
+    return false;
+}
+
+} // namespace
+
+// Runs once per receiver edge, about 70 times for an NEC frame and never while idle
+ISR(PCINT0_vect)
+{
+    profile::Scope scope(profile::IrIsr);
+    uint32_t now = micros();
+    uint32_t length = now - lastEdge;
+    lastEdge = now;
+    // The pin is high again after a mark
+    uint16_t entry = (length > longest ? longest : length) | ((*input & mask) ? markBit : 0);
+    ircapture::Frame frame;
+    if (step(entry, frame) && !frames.push(frame)) {
+        ++overrunCount;
+    }
+}
+
+namespace ircapture
+{
+void begin()
+{
+    pinMode(pin, INPUT_PULLUP);
+    input = portInputRegister(digitalPinToPort(pin));
+    mask = digitalPinToBitMask(pin);
+    PCMSK0 |= _BV(PCINT2);
+    PCIFR = _BV(PCIF0);
+    PCICR |= _BV(PCIE0);
+}
+
+bool decode(Frame& frame)
+{
+    noInterrupts();
+    bool any = frames.pop(frame);
+    interrupts();
+    return any;
+}
+
+uint16_t overruns()
+{
+    noInterrupts();
+    uint16_t count = overrunCount;
+    interrupts();
+    return count;
+}
+} // namespace ircapture
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#include <inttypes.h>
+
+// IR front end without a sampling timer. A pin change interrupt on the receiver times
+// every mark and space and feeds it to an NEC decoder, finished frames wait in a small
+// queue until decode() takes them from the main loop. Nothing runs while the remote is
+// quiet, and a long loop pass only delays frames instead of losing them.
+namespace ircapture
+{
+// IRremote's decode_type_t value and repeat flag, so learned codes and traces are the
+// same with either backend
+constexpr uint8_t nec = 8;
+constexpr uint8_t repeatFlag = 0x01;
+
+struct Frame
+{
+    uint8_t protocol;
+    uint16_t address; // 8 bits, or 16 for extended NEC
+    uint16_t command;
+    bool repeat; // the button is still held, address and command are the last frame's
+};
+
+void begin();
+bool decode(Frame& frame);
+// Frames lost to a full queue since boot
+uint16_t overruns();
+} // namespace ircapture
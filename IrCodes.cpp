@@ -0,0 +1,193 @@
+#include "IrCodes.h"
+#include "Keymap.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <HID-Project.h>
+#include <avr/eeprom.h>
+
+namespace
+{
+using action::make;
+
+// Above the keymap banks
+constexpr uint16_t tableBase = 768;
+static_assert(keymap::bankBase + 2 * sizeof(keymap::Image) <= tableBase,
+    "keymap banks run into the IR table");
+// protocol, address, command, action. An erased protocol byte marks an empty slot.
+constexpr uint8_t entrySize = 7;
+constexpr uint8_t empty = 0xFF;
+// In the protocol byte while a slot in use is rewritten: not valid, but not the end of a
+// probe either, so the codes after it stay reachable
+constexpr uint8_t rewriting = 0xFE;
+static_assert(tableBase + ircodes::slots * entrySize <= 1024, "IR table past the EEPROM");
+
+struct Fallback
+{
+    uint8_t command;
+    uint16_t action;
+};
+
+const Fallback fallbacks[] PROGMEM = {
+    {0x45, make(action::Consumer, MEDIA_VOL_MUTE)},
+    {0x44, make(action::Consumer, MEDIA_PREVIOUS)},
+    {0x40, make(action::Consumer, MEDIA_PLAY_PAUSE)},
+    {0x43, make(action::Consumer, MEDIA_NEXT)},
+    {0x07, make(action::Key, KEY_LEFT_ARROW)},
+    {0x09, make(action::Key, KEY_RIGHT_ARROW)},
+    {0x46, make(action::Command, action::VolumeUp)},
+    {0x15, make(action::Command, action::VolumeDown)},
+};
+
+enum class State : uint8_t { Idle, Writing, Clearing };
+
+State state = State::Idle;
+uint8_t pending[entrySize];
+uint8_t pendingSlot = 0;
+uint8_t cursor = 0;
+
+uint16_t slotAddress(uint8_t slot)
+{
+    return tableBase + slot * entrySize;
+}
+
+uint16_t readWord(uint16_t address)
+{
+    return EEPROM.read(address) | EEPROM.read(address + 1) << 8;
+}
+
+uint8_t hash(const ircodes::Code& code)
+{
+    uint16_t h = code.protocol;
+    h = h * 31 + code.address;
+    h = h * 31 + code.command;
+    return (h ^ h >> 8) % ircodes::slots;
+}
+
+// Slot holding `code`, or the empty slot it would go to, or `slots` when the table
+// is full without it
+uint8_t find(const ircodes::Code& code)
+{
+    uint8_t slot = hash(code);
+    for (uint8_t probe = 0; probe < ircodes::slots; ++probe) {
+        uint16_t address = slotAddress(slot);
+        uint8_t protocol = EEPROM.read(address);
+        if (protocol == empty ||
+            ((protocol == code.protocol || protocol == rewriting) &&
+                readWord(address + 1) == code.address && readWord(address + 3) == code.command)) {
+            return slot;
+        }
+        slot = (slot + 1) % ircodes::slots;
+    }
+    return ircodes::slots;
+}
+
+uint16_t fallback(uint16_t command)
+{
+    for (const auto& entry : fallbacks) {
+        if (pgm_read_byte(&entry.command) == command) {
+            return pgm_read_word(&entry.action);
+        }
+    }
+    return action::None;
+}
+
+// Step 0 marks a slot in use as being rewritten, then the rest of it is written and the
+// protocol byte goes last, so a slot only turns valid once all of it is written
+constexpr uint8_t writeSteps = entrySize + 1;
+
+bool valid(uint8_t protocol)
+{
+    return protocol != empty && protocol != rewriting;
+}
+} // namespace
+
+namespace ircodes
+{
+uint16_t lookup(const Code& code)
+{
+    uint8_t slot = find(code);
+    if (slot < slots && valid(EEPROM.read(slotAddress(slot)))) {
+        return readWord(slotAddress(slot) + 5);
+    }
+    return fallback(code.command);
+}
+
+bool learn(const Code& code, uint16_t action)
+{
+    if (state != State::Idle || !valid(code.protocol)) {
+        return false;
+    }
+    pendingSlot = find(code);
+    if (pendingSlot == slots) {
+        return false;
+    }
+    pending[0] = code.protocol;
+    memcpy(pending + 1, &code.address, 2);
+    memcpy(pending + 3, &code.command, 2);
+    memcpy(pending + 5, &action, 2);
+    uint16_t address = slotAddress(pendingSlot);
+    bool rebind = valid(EEPROM.read(address)) && readWord(address + 5) != action;
+    cursor = rebind ? 0 : 1;
+    state = State::Writing;
+    return true;
+}
+
+bool clear()
+{
+    if (state != State::Idle) {
+        return false;
+    }
+    cursor = 0;
+    state = State::Clearing;
+    return true;
+}
+
+bool busy()
+{
+    return state != State::Idle;
+}
+
+bool entry(uint8_t slot, Code& code, uint16_t& action)
+{
+    uint16_t address = slotAddress(slot);
+    code.protocol = EEPROM.read(address);
+    if (!valid(code.protocol)) {
+        return false;
+    }
+    code.address = readWord(address + 1);
+    code.command = readWord(address + 3);
+    action = readWord(address + 5);
+    return true;
+}
+
+// One byte per call at most, and only when the previous write cycle is over
+void poll()
+{
+    while (state != State::Idle && eeprom_is_ready()) {
+        uint16_t address;
+        uint8_t value;
+        if (state == State::Writing) {
+            if (cursor == writeSteps) {
+                state = State::Idle;
+                return;
+            }
+            uint8_t offset = cursor % entrySize;
+            address = slotAddress(pendingSlot) + offset;
+            value = cursor == 0 ? rewriting : pending[offset];
+            ++cursor;
+        } else {
+            if (cursor == slots) {
+                state = State::Idle;
+                return;
+            }
+            address = slotAddress(cursor++);
+            value = empty;
+        }
+        if (EEPROM.read(address) != value) {
+            EEPROM.write(address, value);
+            return;
+        }
+    }
+}
+} // namespace ircodes
@@ -0,0 +1,31 @@
+#pragma once
+#include <inttypes.h>
+
+// Learned IR codes: (protocol, address, command) -> action, see Keymap.h for actions.
+// The table is an open-addressed hash table with linear probing that lives in the
+// EEPROM and is read in place, so a lookup costs a probe or two of EEPROM reads
+// however many codes are learned. Codes that were never learned fall back to the
+// compiled-in bindings of the original remote, which match on the command alone.
+namespace ircodes
+{
+constexpr uint8_t slots = 32;
+
+struct Code
+{
+    uint8_t protocol;
+    uint16_t address;
+    uint16_t command;
+};
+
+uint16_t lookup(const Code& code);
+// Binds `code` to `action`, replacing an earlier binding of the same code. Written in
+// the background, false while a previous write is running or when the table is full.
+bool learn(const Code& code, uint16_t action);
+// Forgets every learned code
+bool clear();
+bool busy();
+// Slot `slot` of the table, false when it is empty
+bool entry(uint8_t slot, Code& code, uint16_t& action);
+
+void poll();
+} // namespace ircodes
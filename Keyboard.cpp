@@ -2,228 +2,486 @@
 #include "Out.h"
 #include "Leds.h"
 #include "Settings.h"
+#include "Trace.h"
+#include "Hid.h"
+#include "Tick.h"
+#include "Matrix.h"
+#include "Health.h"
+#include "Profile.h"
+#include "Diag.h"
+#include "Keymap.h"
+#include "Input.h"
+#include "IR.h"
 
 #include <Arduino.h>
-#include <MultiReport/Consumer.h>
-#include <MultiReport/ImprovedKeyboard.h>
-#include <SingleReport/BootKeyboard.h>
 
-#include <map>
 #include <array>
 
 namespace
 {
-constexpr int numRows = 5;
-constexpr int numCols = 4;
-std::array<int, numRows> rows = {10, 6, 5, 15, 14};
-std::array<int, numCols> cols = {21, 20, 19, 18};
-std::array<byte, numRows * numCols> buttonState;
-constexpr int fnBtn = 4;
+const uint8_t rows[] = {10, 6, 5, 15, 14};
+const uint8_t cols[] = {21, 20, 19, 18};
+typedef Matrix<sizeof(rows), sizeof(cols)> KeyMatrix;
+KeyMatrix matrix(rows, cols);
+Queue<KeyEvent, 8> keyEvents;
+static_assert(KeyMatrix::numKeys == keymap::keys, "keymap size must match the matrix");
 
-typedef void (*BtnFunc)();
+bool idle = false;
+uint32_t lastActivity = 0;
+// A key woke the suspended host, its events wait in keyEvents until the bus is back
+bool waking = false;
 
-std::map<int, KeyboardKeycode> buttonMapping = {{5, KEY_INSERT}, {6, KEY_HOME}, {7, KEY_PAGE_UP},
-    {8, KEY_LEFT_ALT}, {9, KEY_DELETE}, {10, KEY_END}, {11, KEY_PAGE_DOWN}, {12, KEY_LEFT_SHIFT},
-    {14, KEY_UP_ARROW}, {16, KEY_LEFT_CTRL}, {17, KEY_LEFT_ARROW}, {18, KEY_DOWN_ARROW},
-    {19, KEY_RIGHT_ARROW}};
+// Debounced key state. The first edge of a key is reported at once and further edges
+// are ignored for settings.debounce ms, then the window closes and the key is reported
+// again if the raw state ended up different.
+struct Debounce
+{
+    uint32_t lastEdge = 0; // time of the last reported edge
+    uint8_t burst = 0;     // ms from lastEdge to the last ignored edge
+    bool down = false;
+    bool open = false;
+};
+std::array<Debounce, KeyMatrix::numKeys> debounce;
+std::array<KeyHealth, KeyMatrix::numKeys> health;
+uint8_t openWindows = 0;
+// Fn+11: key presses show the key's health on the LCD instead of being sent
+bool healthPage = false;
+
+// Action each key triggered on press. The release undoes that one, even if the layer
+// changed in between.
+std::array<uint16_t, KeyMatrix::numKeys> pressedActions;
+
+// Dual-role keys. A key bound to a TapHold action waits in a slot until the earliest
+// event that settles it: its own release makes it a tap; the tapping term running out,
+// or another key as settings.tapHoldMode says, makes it a hold. Key events that arrive
+// meanwhile are deferred and replayed in order once it is settled, so they see the
+// modifier or layer of the hold.
+enum class Role : uint8_t { Free, Undecided, Tapped, Held };
+// An aggregate for C++11, the zeroed slots start out Free
+struct DualRole
+{
+    uint8_t key;
+    Role role;
+    uint32_t since;
+};
+std::array<DualRole, 4> dualRoles;
+DualRole* undecided = nullptr;
+Queue<KeyEvent, 16> deferred;
 
-void uname()
+void showHealth(int idx)
 {
-    Keyboard.print(F(""));
+    const auto& key = health[idx];
+    lcd.cprint(F("K"));
+    lcd.print(idx);
+    lcd.print(F(" p"));
+    lcd.print(key.presses);
+    lcd.print(F(" r"));
+    lcd.print(key.rejected);
+    lcd.setCursor(0, 1);
+    if (key.shortestPress != KeyHealth::none) {
+        lcd.print(key.shortestPress);
+    }
+    lcd.print('/');
+    if (key.shortestRelease != KeyHealth::none) {
+        lcd.print(key.shortestRelease);
+    }
+    for (auto count : key.bounce) {
+        lcd.print(' ');
+        lcd.print(count, 5000);
+    }
 }
 
-void pwd()
+// Runs `act` for a key event, see input::execute()
+void run(uint8_t idx, uint16_t act, input::Edge edge)
 {
-    Keyboard.print(F(""));
+    input::execute({input::Matrix, idx, edge, tick::now()}, act);
 }
 
-void mute()
+uint16_t tapAction(uint16_t act)
 {
-    Consumer.write(MEDIA_VOL_MUTE);
-    setLedAnimation({1, 9, 73, 219, 255, 0, 0, 0}, 5, 100);
+    return action::make(action::Key, action::value(act) & 0xFF);
 }
 
-std::map<int, BtnFunc> consumerMapping = {{0, &mute}, {1, [](){Consumer.write(MEDIA_PREVIOUS);}},
-{2, [](){Consumer.write(MEDIA_PLAY_PAUSE);}},{3, [](){Consumer.write(MEDIA_NEXT);}}};
+uint16_t holdAction(uint16_t act)
+{
+    uint8_t hold = action::value(act) >> 8;
+    return hold < action::holdLayer ? action::make(action::Key, KEY_LEFT_CTRL + hold)
+                                    : action::make(action::Layer, 1);
+}
 
-void onKeyDown(int idx)
+DualRole* dualRole(uint8_t key)
 {
-    out::cout << F("Pressed ") << idx << out::endl;
-    if (buttonState.at(fnBtn) == LOW) {
-        switch (idx) {
-            case 1:
-                settings.keyPressEcho = !settings.keyPressEcho;
-                lcd.cprint(F("Key echo: "));
-                lcd.print(settings.keyPressEcho ? F("ON") : F("OFF"));
-                break;
-            case 2:
-                settings.irDebug = !settings.irDebug;
-                lcd.cprint(F("IR debug: "));
-                lcd.print(settings.irDebug ? F("ON") : F("OFF"));
-                break;
-            case 3:
-                settings.ledsEnabled = !settings.ledsEnabled;
-                lcd.cprint(F("LEDs: "));
-                lcd.print(settings.ledsEnabled ? F("ON") : F("OFF"));
-                setLeds(0, 0);
-                break;
-            case 5:
-                settings.lcdEnabled = !settings.lcdEnabled;
-                if (settings.lcdEnabled) {
-                    lcd.cprint(F("LCD: ON"));
-                } else {
-                    lcd.clear();
-                }
-                break;
-            case 6:
-                settings.irEnabled = !settings.irEnabled;
-                lcd.cprint(F("IR: "));
-                lcd.print(settings.irEnabled ? F("ON") : F("OFF"));
-                break;
-            case 7:
-                lcd.shiftBounceType();
-                lcd.cprint(F("Bounce: "));
-                switch (lcd.getBounceType()) {
-                    case LiquidCrystal::BounceType::Bounce:
-                        lcd.print("Bounce");
-                        break;
-                    case LiquidCrystal::BounceType::Loop:
-                        lcd.print("Loop");
-                        break;
-                    case LiquidCrystal::BounceType::None:
-                        lcd.print("None");
-                        break;
-                }
-                break;
-            case 8:
-                settings.keyboardEnabled = !settings.keyboardEnabled;
-                lcd.cprint(F("Keyboard: "));
-                lcd.print(settings.keyboardEnabled ? F("ON") : F("OFF"));
-                break;
-            case 9:
-                settings.randomLeds = !settings.randomLeds;
-                lcd.cprint(F("Rand LEDs: "));
-                lcd.print(settings.randomLeds ? F("ON") : F("OFF"));
-                break;
+    for (auto& slot : dualRoles) {
+        if (slot.role != Role::Free && slot.key == key) {
+            return &slot;
         }
-        return;
     }
+    return nullptr;
+}
 
-    if (!settings.keyboardEnabled) {
-        return;
+DualRole* freeDualRole()
+{
+    for (auto& slot : dualRoles) {
+        if (slot.role == Role::Free) {
+            return &slot;
+        }
     }
+    return nullptr;
+}
 
-    if (settings.keyPressEcho) {
-        lcd.cprint(F("Key down: "));
-        lcd.print(idx);
+void decide(bool hold)
+{
+    auto& slot = *undecided;
+    undecided = nullptr;
+    uint16_t act = pressedActions[slot.key];
+    if (hold) {
+        slot.role = Role::Held;
+        run(slot.key, holdAction(act), input::Press);
+    } else {
+        slot.role = Role::Tapped;
+        run(slot.key, tapAction(act), input::Tap);
     }
+}
 
-    if (buttonMapping.count(idx) > 0) {
-        auto key = buttonMapping[idx];
-        out::cout << F("Sending ") << key << F(" ") << KeyboardKeycode((uint8_t)(key & 0xFF))
-                  << out::endl;
-        Keyboard.press(key);
-    } else if (consumerMapping.count(idx) > 0) {
-        consumerMapping[idx]();
+void onKeyDown(int idx)
+{
+    out::cout << F("Pressed ") << idx << out::endl;
+    uint16_t act = keymap::lookup(input::layer(), idx);
+    if (irLearningWantsKey() && action::tag(act) != action::Layer &&
+        act != action::make(action::Command, action::IrLearn)) {
+        learnIr(action::tag(act) == action::TapHold ? tapAction(act) : act);
+        pressedActions[idx] = action::None;
+        return;
+    }
+    if (input::layer() == 0 && action::tag(act) != action::Layer) {
+        if (healthPage) {
+            showHealth(idx);
+            act = action::None;
+        } else if (settings.keyPressEcho && settings.keyboardEnabled) {
+            lcd.cprint(F("Key down: "));
+            lcd.print(idx);
+        }
+    }
+    if (action::tag(act) == action::TapHold) {
+        if (auto slot = freeDualRole()) {
+            *slot = {static_cast<uint8_t>(idx), Role::Undecided, tick::now()};
+            undecided = slot;
+            pressedActions[idx] = act;
+            return;
+        }
+        // All slots taken, a plain key then
+        act = tapAction(act);
     }
+    pressedActions[idx] = act;
+    run(idx, act, input::Press);
 }
 
 void onKeyUp(int idx)
 {
     out::cout << F("Released ") << idx << out::endl;
-
-    if (buttonState.at(fnBtn) == LOW) {
-        return;
-    }
-
-    if (!settings.keyboardEnabled) {
+    uint16_t act = pressedActions[idx];
+    pressedActions[idx] = action::None;
+    if (action::tag(act) == action::TapHold) {
+        auto slot = dualRole(idx);
+        if (slot->role == Role::Held) {
+            run(idx, holdAction(act), input::Release);
+        }
+        slot->role = Role::Free;
         return;
     }
-
-    if (settings.keyPressEcho) {
+    if (input::layer() == 0 && action::tag(act) != action::Layer && !healthPage &&
+        settings.keyPressEcho && settings.keyboardEnabled) {
         lcd.clear();
         lcd.setCursor(0, 0);
         lcd.print(F("Key up: "));
         lcd.print(idx);
     }
+    run(idx, act, input::Release);
+}
+
+// Whether the deferred events settle the undecided key, and as what
+bool settles(bool& hold)
+{
+    for (uint8_t i = 0; i < deferred.size(); ++i) {
+        const auto& event = deferred.peek(i);
+        if (event.key == undecided->key) {
+            // Its release
+            hold = false;
+            return true;
+        }
+        if (event.pressed && settings.tapHoldMode == 2) {
+            hold = true;
+            return true;
+        }
+        if (!event.pressed && settings.tapHoldMode == 1) {
+            for (uint8_t j = 0; j < i; ++j) {
+                if (deferred.peek(j).key == event.key) {
+                    hold = true;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
 
-    if (buttonMapping.count(idx) > 0) {
-        Keyboard.release(buttonMapping[idx]);
+// Runs deferred events until one has to wait for an undecided key
+void drain()
+{
+    KeyEvent event;
+    while (true) {
+        bool hold;
+        if (undecided != nullptr) {
+            if (!settles(hold)) {
+                return;
+            }
+            decide(hold);
+        }
+        if (!deferred.pop(event)) {
+            return;
+        }
+        if (event.pressed) {
+            onKeyDown(event.key);
+        } else {
+            onKeyUp(event.key);
+        }
     }
-    if (idx == 8) {
-        pwd();
-    } else if (idx == 12) {
-        uname();
+}
+
+void dispatch(uint8_t idx, bool pressed)
+{
+    // Only ever full behind an undecided key, which has then waited long enough
+    while (!deferred.push({idx, pressed})) {
+        decide(true);
+        drain();
     }
+    drain();
 }
 
-void processButton(int idx, int value)
+void report(uint8_t idx, bool pressed)
 {
-    if (buttonState.at(idx) == value) {
-        return;
+    auto& key = debounce[idx];
+    // Nothing to measure against before the key's first edge
+    uint32_t since = key.lastEdge ? tick::now() - key.lastEdge : KeyHealth::none;
+    key.down = pressed;
+    key.lastEdge = tick::now();
+    if (settings.debounce > 0) {
+        key.open = true;
+        ++openWindows;
     }
-    buttonState[idx] = value;
-    if (value == LOW) {
-        onKeyDown(idx);
+    if (pressed) {
+        health[idx].pressed(since);
     } else {
-        onKeyUp(idx);
+        health[idx].released(since);
     }
+    dispatch(idx, pressed);
 }
-} // namespace
 
-void setupKeyboard()
+void closeWindow(uint8_t idx)
+{
+    auto& key = debounce[idx];
+    key.open = false;
+    --openWindows;
+    if (key.burst > 0) {
+        health[idx].bounced(key.burst);
+        key.burst = 0;
+    }
+}
+
+void processButton(const KeyEvent& event)
 {
-    for (auto row : cols) {
-        out::cout << row << F(" as input");
-        pinMode(row, INPUT);
+    auto& key = debounce[event.key];
+    if (key.open) {
+        uint32_t since = tick::now() - key.lastEdge;
+        if (since < settings.debounce) {
+            KeyHealth::increment(health[event.key].rejected);
+            key.burst = constrain(since, 1, 255);
+            return;
+        }
+        closeWindow(event.key);
+    }
+    if (event.pressed != key.down) {
+        report(event.key, event.pressed);
     }
+}
 
-    for (auto col : rows) {
-        out::cout << col << F(" as input-pullup");
-        pinMode(col, INPUT_PULLUP);
+// Reports keys whose raw state moved while their window was open
+void settle()
+{
+    for (uint8_t idx = 0; idx < KeyMatrix::numKeys && openWindows > 0; ++idx) {
+        auto& key = debounce[idx];
+        if (!key.open || tick::now() - key.lastEdge < settings.debounce) {
+            continue;
+        }
+        closeWindow(idx);
+        if (matrix.pressed(idx) != key.down) {
+            report(idx, matrix.pressed(idx));
+        }
     }
-    for (auto& btn : buttonState) {
-        btn = HIGH;
+}
+
+void enterIdle()
+{
+    matrix.enterIdle();
+    idle = true;
+    out::cout << F("Matrix idle") << out::endl;
+}
+
+void leaveIdle()
+{
+    matrix.leaveIdle();
+    idle = false;
+}
+
+// Nothing may be sent while the bus is suspended. The matrix sits in the idle probe
+// until a key asks the host to wake up, then it is scanned into the queue as usual and
+// the events are handled once the host has resumed the bus.
+void scanSuspended()
+{
+    if (idle) {
+        // Keys do nothing when the host has not enabled remote wakeup
+        if (!matrix.probe() || !hid::wakeup()) {
+            return;
+        }
+        leaveIdle();
+        waking = true;
     }
+    matrix.scan(keyEvents);
+}
+} // namespace
+
+void setupKeyboard()
+{
+    matrix.begin();
+    lastActivity = tick::now();
 
-    Keyboard.begin();
-    Consumer.begin();
-    BootKeyboard.begin();
+    hid::begin();
+    hid::onLeds(&onHostLeds);
+    hid::onSuspend(&onHostSuspend);
 }
 
+// The columns sit on PORTF which has no pin change interrupts on the 32u4. While idle
+// all rows stay driven low and each wakeup costs a single probe of the columns.
 void readMatrix()
 {
-    int buttonIdx = 0;
-    // iterate the rows
-    for (auto col : rows) {
-        // col: set to output to low
-        pinMode(col, OUTPUT);
-        digitalWrite(col, LOW);
+    profile::Scope scope(profile::Scan);
+    diag::count(diag::Scans);
+    if (hid::suspended()) {
+        scanSuspended();
+        return;
+    }
+    if (idle) {
+        if (!matrix.probe()) {
+            return;
+        }
+        // Scan right away so the key that woke us is reported in this pass
+        leaveIdle();
+    }
+    waking = false;
+    bool active = matrix.scan(keyEvents) || keyEvents.size() > 0;
+    if (keyEvents.size() > 0) {
+        uint8_t keys[(KeyMatrix::numKeys + 7) / 8];
+        matrix.pack(keys);
+        traceMatrix(keys, sizeof(keys));
+    }
+    KeyEvent event;
+    while (keyEvents.pop(event)) {
+        processButton(event);
+    }
+    if (openWindows > 0) {
+        settle();
+        active = true;
+    }
+    if (undecided != nullptr && tick::now() - undecided->since >= settings.tappingTerm) {
+        decide(true);
+        drain();
+    }
+    // Scroll actions of this pass as one report
+    input::flush();
+    if (active) {
+        lastActivity = tick::now();
+    } else if (settings.idleTimeout > 0 && tick::now() - lastActivity > settings.idleTimeout) {
+        enterIdle();
+    }
+}
+
+void scanOnly()
+{
+    // A scan leaves all rows undriven, which the idle probe can't see a key through
+    if (idle) {
+        leaveIdle();
+    }
+    matrix.scan(keyEvents);
+}
+
+bool keyboardIdle()
+{
+    return idle;
+}
+
+bool toggleHealthPage()
+{
+    healthPage = !healthPage;
+    return healthPage;
+}
+
+int keyCount()
+{
+    return KeyMatrix::numKeys;
+}
+
+KeyHealth& keyHealth(int idx)
+{
+    return health[idx];
+}
+
+void resetHealth()
+{
+    health.fill(KeyHealth());
+}
+
+uint8_t keyQueueHighWater()
+{
+    uint8_t highWater = keyEvents.highWater();
+    keyEvents.resetHighWater();
+    return highWater;
+}
 
-        // row: interate through the cols
-        for (auto row : cols) {
-            pinMode(row, INPUT_PULLUP);
-            processButton(buttonIdx++, digitalRead(row));
-            pinMode(row, INPUT);
+void describeKey(int idx, Print& out)
+{
+    out.print(idx);
+    for (uint8_t layer = 0; layer < keymap::layers; ++layer) {
+        out.print(layer ? F(" / ") : F(" "));
+        action::print(keymap::lookup(layer, idx), out);
+    }
+    out.print('\n');
+}
+
+void onHostSuspend(bool suspended)
+{
+    out::cout << (suspended ? F("Suspend") : F("Resume")) << out::endl;
+    suspendLeds(suspended);
+    if (suspended) {
+        lcd.suspend();
+        if (!waking && !idle) {
+            enterIdle();
         }
-        // disable the column
-        pinMode(col, INPUT);
+    } else {
+        lcd.resume();
     }
 }
 
-void checkLocks()
+void onHostLeds(uint8_t leds)
 {
-    int lockLeds = 0;
-    if (BootKeyboard.getLeds() & LED_CAPS_LOCK) {
+    uint8_t lockLeds = 0;
+    if (leds & LED_CAPS_LOCK) {
         lockLeds |= 16;
     }
-    if (BootKeyboard.getLeds() & LED_NUM_LOCK) {
+    if (leds & LED_NUM_LOCK) {
         lockLeds |= 128;
     }
-    if (BootKeyboard.getLeds() & LED_SCROLL_LOCK) {
+    if (leds & LED_SCROLL_LOCK) {
         lockLeds |= 1;
     }
-    if (!settings.randomLeds && ledTimeout == 0) {
-        setLeds(lockLeds, 0);
-    }
+    setLockLeds(lockLeds);
 }
@@ -1,9 +1,31 @@
 #pragma once
 #include "LCD.h"
 
+class Print;
+struct KeyHealth;
+
 extern "C" {
     void readMatrix();
     void setupKeyboard();
-    void checkLocks();
+    // Lock state from the host, see hid::onLeds()
+    void onHostLeds(uint8_t leds);
+    // Bus suspend and resume from the host, see hid::onSuspend()
+    void onHostSuspend(bool suspended);
+    bool keyboardIdle();
+    int keyCount();
 }
 
+// Fn+11: key presses show the key's health on the LCD instead of being sent. Returns
+// whether it is on now.
+bool toggleHealthPage();
+// Prints what key `idx` is bound to, for the console
+void describeKey(int idx, Print& out);
+// Switch statistics of key `idx`, see Health.h
+KeyHealth& keyHealth(int idx);
+void resetHealth();
+// Deepest the key event queue got since the previous call
+uint8_t keyQueueHighWater();
+// Scans the matrix into the key event queue without handling anything, the edges wait
+// there for the next readMatrix(). For the bench, which must not send reports.
+void scanOnly();
+
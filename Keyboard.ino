@@ -5,9 +5,22 @@
 #include "Volume.h"
 #include "IR.h"
 #include "Settings.h"
+#include "Trace.h"
+#include "Tick.h"
+#include "Timers.h"
+#include "Console.h"
+#include "Storage.h"
+#include "Profile.h"
+#include "Diag.h"
+#include "Hid.h"
+#include "Keymap.h"
+#include "IrCodes.h"
+#include "Watchdog.h"
+#include "FrameSync.h"
 
 #include <HID-Project.h>
 #include <ArduinoSTL.h>
+#include <avr/sleep.h>
 
 #include <array>
 #include <map>
@@ -24,37 +37,52 @@ Settings settings;
 
 void setup()
 {
-    if (out::Enabled) {
-        out::cout.Init();
-    }
+    tick::update();
+    loadSettings();
+    // Early, so that a stall in the rest of setup is caught as well
+    watchdog::begin();
+    keymap::begin();
+    // Input first, the slow peripherals come up in the background
     setupKeyboard();
     setupLeds();
     setupVolume();
     setupIR();
+    if (out::Enabled) {
+        out::cout.Init();
+    }
+    setupConsole();
 
     lcd.begin();
     lcd.print(F("Hello, World!"));
     lcd.setPersistentStrings(F(""), F(""));
-}
 
-struct ScheduledFunction
-{
-    typedef void (*FunPtr)();
-    FunPtr func;
-    int interval;
-    unsigned long last;
-};
-
-ScheduledFunction scheduledFuncs[] = {{&readMatrix, 1, 0}, {&checkVolume, 100, 0},
-    {&blinkLed, 150, 0},/*{&displayLoop, 500, 0},*/ {&checkLocks, 100, 0}, {&checkIR, 100, 0}};
+    timers::every(timers::create(&framesync::timedScan, F("matrix")), 1);
+    timers::every(timers::create(&pollEncoder, F("encoder")), 1);
+    timers::every(timers::create(&checkVolume, F("volume")), 10);
+    timers::every(timers::create(&blinkLed, F("leds")), 150);
+    timers::every(timers::create(&hid::poll, F("hid")), 1);
+    // Decoded frames wait in the IR front end, this only sets how soon they act
+    timers::every(timers::create(&checkIR, F("ir")), 10);
+    timers::every(timers::create(&pollTrace, F("trace")), 10);
+    timers::every(timers::create(&pollConsole, F("console")), 2);
+    timers::every(timers::create(&pollStorage, F("storage")), 10);
+    timers::every(timers::create(&keymap::poll, F("keymap")), 10);
+    timers::every(timers::create(&ircodes::poll, F("ircodes")), 10);
+}
 
 void loop()
 {
-    auto currTime = millis();
-    for (int i = 0; i < sizeof(scheduledFuncs) / sizeof(ScheduledFunction); ++i) {
-        if (currTime - scheduledFuncs[i].last > scheduledFuncs[i].interval) {
-            scheduledFuncs[i].func();
-            scheduledFuncs[i].last = currTime;
-        }
+    PROFILE_MARK(profile::Loop);
+    uint32_t start = micros();
+    tick::update();
+    watchdog::checkIn();
+    framesync::poll();
+    timers::run();
+    diag::loopTime(micros() - start);
+    PROFILE_MARK(profile::Loop + 1);
+    if (keyboardIdle()) {
+        // Timer0 and USB interrupts wake us at least once per millisecond
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
     }
 }
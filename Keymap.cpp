@@ -0,0 +1,237 @@
+#include "Keymap.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <HID-Project.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+namespace
+{
+using action::make;
+
+const keymap::Image defaults PROGMEM = {
+    keymap::version,
+    0,
+    {
+        {
+            make(action::Command, action::Mute), make(action::Consumer, MEDIA_PREVIOUS),
+            make(action::Consumer, MEDIA_PLAY_PAUSE), make(action::Consumer, MEDIA_NEXT),
+            make(action::Layer, 1), make(action::Key, KEY_INSERT),
+            make(action::Key, KEY_HOME), make(action::Key, KEY_PAGE_UP),
+            make(action::Key, KEY_LEFT_ALT), make(action::Key, KEY_DELETE),
+            make(action::Key, KEY_END), make(action::Key, KEY_PAGE_DOWN),
+            make(action::Key, KEY_LEFT_SHIFT), action::None,
+            make(action::Key, KEY_UP_ARROW), action::None,
+            make(action::Key, KEY_LEFT_CTRL), make(action::Key, KEY_LEFT_ARROW),
+            make(action::Key, KEY_DOWN_ARROW), make(action::Key, KEY_RIGHT_ARROW),
+        },
+        {
+            action::None, make(action::Command, action::KeyEcho),
+            make(action::Command, action::IrDebug), make(action::Command, action::Leds),
+            make(action::Layer, 1), make(action::Command, action::Lcd),
+            make(action::Command, action::Ir), make(action::Command, action::Bounce),
+            make(action::Command, action::Keyboard), make(action::Command, action::RandomLeds),
+            make(action::Command, action::Trace), make(action::Command, action::HealthPage),
+            make(action::Command, action::IrLearn), make(action::Command, action::Bench),
+            make(action::Command, action::Diagnostics), action::None,
+            action::None, action::None,
+            action::None, action::None,
+        },
+    },
+    0,
+};
+
+enum class State : uint8_t { Idle, Uploading, Writing };
+
+keymap::Image current;
+keymap::Image staging;
+State state = State::Idle;
+uint8_t liveBank = 0;
+uint8_t targetBank = 0;
+uint8_t cursor = 0;
+
+uint16_t bankAddress(uint8_t bank)
+{
+    return keymap::bankBase + bank * sizeof(keymap::Image);
+}
+
+uint16_t crcOf(const keymap::Image& image)
+{
+    uint16_t crc = 0xFFFF;
+    auto bytes = reinterpret_cast<const uint8_t*>(&image);
+    for (uint8_t i = 0; i < offsetof(keymap::Image, crc); ++i) {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+bool valid(const keymap::Image& image)
+{
+    return image.version == keymap::version && image.crc == crcOf(image);
+}
+
+// Staging becomes the next image: newer than the live one and with its own CRC
+void startWrite()
+{
+    staging.version = keymap::version;
+    staging.sequence = current.sequence + 1;
+    staging.crc = crcOf(staging);
+    targetBank = liveBank ^ 1;
+    cursor = 0;
+    state = State::Writing;
+}
+} // namespace
+
+namespace action
+{
+void print(uint16_t action, Print& out)
+{
+    switch (tag(action)) {
+        case Key:
+            out.print(F("key 0x"));
+            out.print(value(action), HEX);
+            break;
+        case Consumer:
+            out.print(F("media 0x"));
+            out.print(value(action), HEX);
+            break;
+        case Command:
+            out.print(F("cmd "));
+            out.print(value(action));
+            break;
+        case Layer:
+            out.print(F("layer "));
+            out.print(value(action));
+            break;
+        case TapHold:
+            out.print(F("tap 0x"));
+            out.print(value(action) & 0xFF, HEX);
+            out.print(F(" hold "));
+            out.print(value(action) >> 8);
+            break;
+        case Scroll:
+            out.print(value(action) >> 8 ? F("pan ") : F("scroll "));
+            out.print(static_cast<int>(static_cast<int8_t>(value(action))));
+            break;
+        default:
+            out.print(F("none"));
+            break;
+    }
+}
+} // namespace action
+
+namespace keymap
+{
+void begin()
+{
+    Image banks[2];
+    bool ok[2];
+    for (uint8_t bank = 0; bank < 2; ++bank) {
+        EEPROM.get(bankAddress(bank), banks[bank]);
+        ok[bank] = bankAddress(bank) + sizeof(Image) <= EEPROM.length() && valid(banks[bank]);
+    }
+    if (ok[0] && ok[1]) {
+        // Sequence numbers wrap, the newer one is at most 127 ahead
+        liveBank = static_cast<int8_t>(banks[1].sequence - banks[0].sequence) > 0 ? 1 : 0;
+    } else if (ok[0] || ok[1]) {
+        liveBank = ok[1] ? 1 : 0;
+    } else {
+        memcpy_P(&current, &defaults, sizeof(Image));
+        current.crc = crcOf(current);
+        // The first commit goes to bank 0
+        liveBank = 1;
+        return;
+    }
+    current = banks[liveBank];
+}
+
+uint16_t lookup(uint8_t layer, uint8_t key)
+{
+    return current.actions[layer][key];
+}
+
+const Image& live()
+{
+    return current;
+}
+
+bool set(uint8_t layer, uint8_t key, uint16_t action)
+{
+    if (state != State::Idle || layer >= layers || key >= keys) {
+        return false;
+    }
+    staging = current;
+    staging.actions[layer][key] = action;
+    startWrite();
+    return true;
+}
+
+bool beginImage()
+{
+    if (state == State::Writing) {
+        return false;
+    }
+    staging = current;
+    state = State::Uploading;
+    return true;
+}
+
+bool writeImage(uint16_t offset, const uint8_t* data, uint8_t length)
+{
+    if (state != State::Uploading || offset + length > sizeof(Image)) {
+        return false;
+    }
+    memcpy(reinterpret_cast<uint8_t*>(&staging) + offset, data, length);
+    return true;
+}
+
+bool commitImage()
+{
+    if (state != State::Uploading || !valid(staging)) {
+        return false;
+    }
+    startWrite();
+    return true;
+}
+
+bool restoreDefaults()
+{
+    if (state == State::Writing) {
+        return false;
+    }
+    memcpy_P(&staging, &defaults, sizeof(Image));
+    startWrite();
+    return true;
+}
+
+bool busy()
+{
+    return state == State::Writing;
+}
+
+// One byte per call at most, and only when the previous write cycle is over
+void poll()
+{
+    if (state != State::Writing) {
+        return;
+    }
+    uint16_t base = bankAddress(targetBank);
+    auto bytes = reinterpret_cast<const uint8_t*>(&staging);
+    while (cursor < sizeof(Image) && eeprom_is_ready()) {
+        uint8_t value = bytes[cursor];
+        if (EEPROM.read(base + cursor) != value) {
+            EEPROM.write(base + cursor++, value);
+            return;
+        }
+        ++cursor;
+    }
+    if (cursor < sizeof(Image) || !eeprom_is_ready()) {
+        return;
+    }
+    // The CRC went last, the bank is valid from here on
+    current = staging;
+    liveBank = targetBank;
+    state = State::Idle;
+}
+} // namespace keymap
@@ -0,0 +1,114 @@
+#pragma once
+#include <inttypes.h>
+
+class Print;
+
+// Every binding is a 16-bit action: the top 4 bits are a tag saying what the low 12 bits
+// mean.
+namespace action
+{
+enum Tag : uint8_t {
+    None = 0,
+    Key = 1,      // keyboard usage, pressed and released with the key
+    Consumer = 2, // consumer usage, sent once on press
+    Command = 3,  // firmware function, see Command below
+    Layer = 4,    // momentary layer while held
+    TapHold = 5,  // dual-role key, see tapHold() below
+    Scroll = 6,   // wheel detents, see scroll() below
+};
+
+enum Command : uint8_t {
+    Mute = 0, // mute with the LED animation
+    KeyEcho = 1,
+    IrDebug = 2,
+    Leds = 3,
+    Lcd = 5,
+    Ir = 6,
+    Bounce = 7,
+    Keyboard = 8,
+    RandomLeds = 9,
+    Trace = 10,
+    HealthPage = 11,
+    IrLearn = 12,
+    Bench = 13,
+    Diagnostics = 14,
+    VolumeUp = 15,   // one step, repeats while an IR button is held
+    VolumeDown = 16,
+};
+
+constexpr uint16_t make(Tag tag, uint16_t value)
+{
+    return static_cast<uint16_t>(tag) << 12 | (value & 0xFFF);
+}
+
+inline Tag tag(uint16_t action)
+{
+    return static_cast<Tag>(action >> 12);
+}
+
+inline uint16_t value(uint16_t action)
+{
+    return action & 0xFFF;
+}
+
+// Keyboard usage `tap` when tapped. Held, modifier `hold` (0 left ctrl .. 7 right gui,
+// in HID order) or layer 1 for holdLayer.
+constexpr uint8_t holdLayer = 8;
+constexpr uint16_t tapHold(uint8_t tap, uint8_t hold)
+{
+    return make(TapHold, static_cast<uint16_t>(hold) << 8 | tap);
+}
+
+// `detents` of the wheel, positive is up, or of the horizontal pan, positive is right
+constexpr uint16_t scroll(int8_t detents, bool pan)
+{
+    return make(Scroll, static_cast<uint16_t>(pan) << 8 | static_cast<uint8_t>(detents));
+}
+
+// "key 0x4a", "media 0xb5", "cmd 3", "layer 1", "tap 0x2c hold 1", "scroll -1",
+// "pan 1" or "none"
+void print(uint16_t action, Print& out);
+} // namespace action
+
+// Runtime keymap. The live map is a flat table in RAM, loaded at boot from one of two
+// EEPROM banks, or from the compiled-in defaults when neither holds a valid image.
+// Changes are staged in a second RAM copy and written to the bank that is not live,
+// in the background. The new image wins on the next boot only once its CRC, which is
+// written last, is complete, and it goes live in RAM at that same moment. A partial
+// write can never leave a half-applied map in use.
+namespace keymap
+{
+constexpr uint8_t layers = 2;
+constexpr uint8_t keys = 20;
+// The EEPROM below the two banks belongs to Storage.cpp
+constexpr uint16_t bankBase = 512;
+
+// Binary image, identical in EEPROM, in RAM and over serial. The CRC is CRC-16/ARC
+// (avr-libc's _crc16_update, initial value 0xFFFF) over all bytes before it.
+struct Image
+{
+    uint8_t version;
+    uint8_t sequence; // bumped on every commit, the newer valid bank wins
+    uint16_t actions[layers][keys];
+    uint16_t crc;
+};
+// 2: the IR bindings moved to IrCodes.h
+constexpr uint8_t version = 2;
+
+void begin();
+uint16_t lookup(uint8_t layer, uint8_t key);
+const Image& live();
+
+// Per-entry changes, written right away. False while a write is still running.
+bool set(uint8_t layer, uint8_t key, uint16_t action);
+// Whole-image upload: begin() copies the live map into the staging image, write()
+// patches its bytes, commit() checks the uploaded CRC and starts the write.
+bool beginImage();
+bool writeImage(uint16_t offset, const uint8_t* data, uint8_t length);
+bool commitImage();
+// Stage and write the compiled-in defaults
+bool restoreDefaults();
+bool busy();
+
+void poll();
+} // namespace keymap
@@ -6,6 +6,15 @@
 #include <string.h>
 #include <inttypes.h>
 #include "Arduino.h"
+
+namespace
+{
+constexpr int bounceInterval = 450;
+constexpr int displayWidth = 16;
+// Each row of the 2-line controller owns 40 DDRAM columns, of which 16 are visible
+constexpr int ddramLineLength = 40;
+} // namespace
+
 // When the display powers up, it is configured as follows:
 //
 // 1. Display clear
@@ -30,7 +39,6 @@ LiquidCrystal::LiquidCrystal(uint8_t latchPin, uint8_t clockPin, uint8_t dataPin
     , clockPin_(clockPin)
     , dataPin_(dataPin)
 {
-    init();
 }
 
 void LiquidCrystal::init()
@@ -38,50 +46,88 @@ void LiquidCrystal::init()
     begin();
 }
 
+// Starts the power-on sequence and returns right away. The waits between the steps run
+// on a timer, everything sent before the display is ready is dropped.
 void LiquidCrystal::begin()
 {
+    if (displayTimer_ == timers::none) {
+        displayTimer_ = timers::create(&onDisplayTimeout, F("lcd timeout"));
+        marqueeTimer_ = timers::create(&onMarqueeStep, F("marquee"));
+        initTimer_ = timers::create(&onInitStep, F("lcd init"));
+    }
+    ready_ = false;
+    initStep_ = 0;
+
     setRowOffsets(0x00, 0x40, 0x00 + 16, 0x40 + 16);
 
     // SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
     // according to datasheet, we need at least 40ms after power rises above 2.7V
     // before sending commands. Arduino can turn on way before 4.5V so we'll wait 50
-    delayMicroseconds(50000);
-    // Now we pull both RS and R/W low to begin commands
-    rsPin_ = LOW;
-    enablePin_ = LOW;
+    timers::start(initTimer_, 50);
+}
+
+void LiquidCrystal::onInitStep()
+{
+    lcd.initStep();
+}
 
+void LiquidCrystal::initStep()
+{
     // this is according to the hitachi HD44780 datasheet
     // figure 24, pg 46
+    switch (initStep_++) {
+        case 0:
+            // Now we pull both RS and R/W low to begin commands
+            rsPin_ = LOW;
+            enablePin_ = LOW;
+
+            // we start in 8bit mode, try to set 4 bit mode
+            write4bits(0x03);
+            timers::start(initTimer_, 5); // wait min 4.1ms
+            break;
+        case 1:
+            // second try
+            write4bits(0x03);
+            timers::start(initTimer_, 5); // wait min 4.1ms
+            break;
+        default:
+            // third go!
+            write4bits(0x03);
+            delayMicroseconds(150);
 
-    // we start in 8bit mode, try to set 4 bit mode
-    write4bits(0x03);
-    delayMicroseconds(4500); // wait min 4.1ms
-
-    // second try
-    write4bits(0x03);
-    delayMicroseconds(4500); // wait min 4.1ms
+            // finally, set to 4-bit interface
+            write4bits(0x02);
+            ready_ = true;
 
-    // third go!
-    write4bits(0x03);
-    delayMicroseconds(150);
+            // finally, set # lines, font size, etc.
+            command(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS | LCD_2LINE);
 
-    // finally, set to 4-bit interface
-    write4bits(0x02);
+            // turn the display on with no cursor or blinking default
+            displayControl_ = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+            if (suspended_) {
+                displayControl_ &= ~LCD_DISPLAYON;
+            }
+            command(LCD_DISPLAYCONTROL | displayControl_);
 
-    // finally, set # lines, font size, etc.
-    command(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS | LCD_2LINE);
+            // clear it off
+            clear();
 
-    // turn the display on with no cursor or blinking default
-    displayControl_ = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
-    display();
+            // Initialize to default text direction (for romance languages)
+            displayMode_ = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+            // set the entry mode
+            command(LCD_ENTRYMODESET | displayMode_);
 
-    // clear it off
-    clear();
+            showPersistent();
+            if (!suspended_) {
+                timers::every(marqueeTimer_, bounceInterval);
+            }
+            break;
+    }
+}
 
-    // Initialize to default text direction (for romance languages)
-    displayMode_ = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
-    // set the entry mode
-    command(LCD_ENTRYMODESET | displayMode_);
+bool LiquidCrystal::ready() const
+{
+    return ready_;
 }
 
 void LiquidCrystal::setRowOffsets(int row0, int row1, int row2, int row3)
@@ -95,14 +141,28 @@ void LiquidCrystal::setRowOffsets(int row0, int row1, int row2, int row3)
 /********** high level commands, for the user! */
 void LiquidCrystal::clear()
 {
+    if (!ready_) {
+        return;
+    }
     command(LCD_CLEARDISPLAY); // clear display, set cursor position to zero
     delayMicroseconds(2000);   // this command takes a long time!
+    cursorRow_ = 0;
+    cursorCol_ = 0;
+    shift_ = 0;
+    ++generation_;
 }
 
 void LiquidCrystal::home()
 {
+    if (!ready_) {
+        return;
+    }
     command(LCD_RETURNHOME); // set cursor position to zero
     delayMicroseconds(2000); // this command takes a long time!
+    cursorRow_ = 0;
+    cursorCol_ = 0;
+    shift_ = 0;
+    ++generation_;
 }
 
 void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
@@ -115,7 +175,9 @@ void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
         row = 1; // we count rows starting w/0
     }
 
-    command(LCD_SETDDRAMADDR | (col + rowOffsets_[row]));
+    cursorRow_ = row;
+    cursorCol_ = (col + shift_) % ddramLineLength;
+    command(LCD_SETDDRAMADDR | (cursorCol_ + rowOffsets_[row]));
 }
 
 // Turn the display on/off (quickly)
@@ -158,10 +220,12 @@ void LiquidCrystal::blink()
 void LiquidCrystal::scrollDisplayLeft(void)
 {
     command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+    shift_ = (shift_ + 1) % ddramLineLength;
 }
 void LiquidCrystal::scrollDisplayRight(void)
 {
     command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+    shift_ = (shift_ + ddramLineLength - 1) % ddramLineLength;
 }
 
 // This is for text that flows Left to Right
@@ -199,8 +263,10 @@ void LiquidCrystal::createChar(uint8_t location, uint8_t charmap[])
     location &= 0x7; // we only have 8 locations 0-7
     command(LCD_SETCGRAMADDR | (location << 3));
     for (int i = 0; i < 8; i++) {
-        write(charmap[i]);
+        send(charmap[i], HIGH);
     }
+    // CGRAM writes leave the address counter there, point it back to the text
+    setCursor(0, 0);
 }
 
 /*********** mid level commands, for sending data/cmds */
@@ -212,7 +278,13 @@ inline void LiquidCrystal::command(uint8_t value)
 
 inline size_t LiquidCrystal::write(uint8_t value)
 {
+    // The controller would continue on the other row, keep the text on this one
+    if (cursorCol_ >= ddramLineLength) {
+        cursorCol_ = 0;
+        command(LCD_SETDDRAMADDR | rowOffsets_[cursorRow_]);
+    }
     send(value, HIGH);
+    ++cursorCol_;
     return 1; // assume sucess
 }
 
@@ -232,6 +304,9 @@ void LiquidCrystal::flushPins()
 
 void LiquidCrystal::send(uint8_t value, uint8_t mode)
 {
+    if (!ready_) {
+        return;
+    }
     rsPin_ = mode;
     flushPins();
 
@@ -263,57 +338,87 @@ void LiquidCrystal::write4bits(uint8_t value)
     pulseEnable();
 }
 
-namespace
+void LiquidCrystal::suspend()
 {
-constexpr int bounceInterval = 450;
+    suspended_ = true;
+    noDisplay();
+    timers::cancel(marqueeTimer_);
 }
 
-void LiquidCrystal::displayLoop()
+void LiquidCrystal::resume()
 {
-    if (displayTimeout_ == 0) {
+    suspended_ = false;
+    display();
+    if (ready_) {
+        timers::every(marqueeTimer_, bounceInterval);
+    }
+}
+
+void LiquidCrystal::onDisplayTimeout()
+{
+    lcd.showPersistent();
+}
+
+void LiquidCrystal::onMarqueeStep()
+{
+    lcd.marqueeStep();
+}
+
+void LiquidCrystal::marqueeStep()
+{
+    // A timed message is on screen
+    if (timers::active(displayTimer_)) {
+        return;
+    }
+    if (scrollHardware_) {
+        scrollStep();
+    } else {
         upper_.bounce();
         lower_.bounce();
     }
-    if (displayTimeout_ > 0 && displayTimeout_ <= millis()) {
-        displayTimeout_ = 0;
-        upper_.reset();
-        lower_.reset();
-    }
-    out::cout << "Display timeout = " << displayTimeout_ << out::endl;
 }
 
 void LiquidCrystal::setPersistentStrings(
     const __FlashStringHelper* upper, const __FlashStringHelper* lower)
 {
     clear();
-    displayTimeout_ = millis();
+    timers::cancel(displayTimer_);
     upper_.set(upper);
     lower_.set(lower);
+    showPersistent();
 }
 
-void LiquidCrystal::setTimeout(unsigned long value)
+void LiquidCrystal::setTimeout(uint16_t timeout)
 {
-    displayTimeout_ = value;
+    timers::start(displayTimer_, timeout);
 }
 
 void LiquidCrystal::shiftBounceType()
 {
     switch (bounceType_) {
         case BounceType::Bounce:
-            bounceType_ = BounceType::Loop;
+            setBounceType(BounceType::Loop);
             break;
         case BounceType::Loop:
-            bounceType_ = BounceType::None;
+            setBounceType(BounceType::None);
             break;
         case BounceType::None:
-            bounceType_ = BounceType::Bounce;
+            setBounceType(BounceType::Bounce);
             break;
         default:
-            bounceType_ = BounceType::Bounce;
+            setBounceType(BounceType::Bounce);
             break;
     }
-    upper_.reset();
-    lower_.reset();
+}
+
+// The redraw takes a few ms, so it runs from the display timer instead of the caller.
+// A timed message on screen ends with one anyway.
+void LiquidCrystal::setBounceType(BounceType type)
+{
+    bounceType_ = type;
+    if (!timers::active(displayTimer_)) {
+        timers::start(displayTimer_, 0);
+    }
 }
 
 LiquidCrystal::BounceType LiquidCrystal::getBounceType()
@@ -321,32 +426,96 @@ LiquidCrystal::BounceType LiquidCrystal::getBounceType()
     return bounceType_;
 }
 
-void displayLoop()
+uint8_t LiquidCrystal::generation() const
+{
+    return generation_;
+}
+
+void LiquidCrystal::touch()
+{
+    ++generation_;
+}
+
+// The display shift command moves both rows at once, so it can only replace the per-row
+// redraw when the non-empty rows scroll the same way: equally long and within their
+// DDRAM line
+bool LiquidCrystal::canScrollHardware() const
+{
+    if (bounceType_ == BounceType::None) {
+        return false;
+    }
+    int upper = upper_.length();
+    int lower = lower_.length();
+    if (upper > 0 && lower > 0 && upper != lower) {
+        return false;
+    }
+    int len = std::max(upper, lower);
+    return len > displayWidth && len <= ddramLineLength;
+}
+
+void LiquidCrystal::showPersistent()
 {
-    lcd.displayLoop();
+    if (shift_ != 0) {
+        home();
+    }
+    ++generation_;
+    scrollHardware_ = canScrollHardware();
+    scrollDir_ = 1;
+    if (scrollHardware_) {
+        upper_.fill();
+        lower_.fill();
+    } else {
+        upper_.reset();
+        lower_.reset();
+    }
+}
+
+void LiquidCrystal::scrollStep()
+{
+    int len = std::max(upper_.length(), lower_.length());
+    switch (bounceType_) {
+        case BounceType::Bounce:
+            if (scrollDir_ < 0 && shift_ <= 0) {
+                scrollDir_ = 1;
+            }
+            if (scrollDir_ > 0 && shift_ >= len - displayWidth) {
+                scrollDir_ = -1;
+            }
+            break;
+        case BounceType::Loop:
+            // Same gap as the per-row redraw, not the blanks up to the end of the DDRAM line
+            if (shift_ >= len - 8) {
+                home();
+                return;
+            }
+            scrollDir_ = 1;
+            break;
+        default:
+            return;
+    }
+    if (scrollDir_ > 0) {
+        scrollDisplayLeft();
+    } else {
+        scrollDisplayRight();
+    }
 }
 
 LiquidCrystal::BouncyStr::BouncyStr(int row)
     : row_(row)
-    , bounceTime_(millis() + bounceInterval)
 {
 }
 
 void LiquidCrystal::BouncyStr::bounce()
 {
-    if (len_ <= 16) {
+    if (len_ <= displayWidth) {
         return;
     }
-    if (bounceTime_ > millis()) {
-        return;
-    }
-    bounceTime_ = millis() + bounceInterval;
     switch (lcd.getBounceType()) {
         case LiquidCrystal::BounceType::Bounce:
             if (dir_ < 0 && idx_ <= 0) {
                 dir_ = 1;
             }
-            if (dir_ > 0 && idx_ >= len_ - 16) {
+            if (dir_ > 0 && idx_ >= len_ - displayWidth) {
                 dir_ = -1;
             }
 
@@ -369,10 +538,10 @@ void LiquidCrystal::BouncyStr::bounce()
 
 void LiquidCrystal::BouncyStr::set(const __FlashStringHelper* val)
 {
-    const char* c = reinterpret_cast<const char*>(val);
-    len_ = strlen_P(c);
-    strncpy_P(str_, c, sizeof(str_));
-    display();
+    str_ = reinterpret_cast<const char*>(val);
+    len_ = strlen_P(str_);
+    idx_ = 0;
+    dir_ = 1;
 }
 
 void LiquidCrystal::BouncyStr::reset()
@@ -382,12 +551,31 @@ void LiquidCrystal::BouncyStr::reset()
     display();
 }
 
+int LiquidCrystal::BouncyStr::length() const
+{
+    return len_;
+}
+
+char LiquidCrystal::BouncyStr::charAt(int pos) const
+{
+    if (pos >= len_) {
+        return ' ';
+    }
+    return pgm_read_byte(str_ + pos);
+}
+
+void LiquidCrystal::BouncyStr::fill()
+{
+    lcd.setCursor(0, row_);
+    for (int i = 0; i < ddramLineLength; ++i) {
+        lcd.write(charAt(i));
+    }
+}
+
 void LiquidCrystal::BouncyStr::display()
 {
     lcd.setCursor(0, row_);
-    int lastChar = std::min(idx_ + 16, len_);
-    auto c = str_[lastChar];
-    str_[lastChar] = 0;
-    lcd.print(str_ + idx_, 0);
-    str_[lastChar] = c;
+    for (int i = 0; i < displayWidth; ++i) {
+        lcd.write(charAt(idx_ + i));
+    }
 }
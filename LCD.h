@@ -5,6 +5,7 @@
 #include <inttypes.h>
 #include "Print.h"
 #include "Settings.h"
+#include "Timers.h"
 
 class LiquidCrystal;
 extern "C" LiquidCrystal lcd;
@@ -47,10 +48,6 @@ extern "C" LiquidCrystal lcd;
 #define LCD_5x10DOTS 0x04
 #define LCD_5x8DOTS 0x00
 
-extern "C" {
-void displayLoop();
-}
-
 class LiquidCrystal : public Print
 {
 public:
@@ -60,6 +57,8 @@ enum class BounceType{Bounce, Loop, None};
     void init();
 
     void begin();
+    // False until the power-on sequence started by begin() has finished
+    bool ready() const;
 
     void clear();
     void home();
@@ -79,6 +78,7 @@ enum class BounceType{Bounce, Loop, None};
 
     void setRowOffsets(int row1, int row2, int row3, int row4);
     void createChar(uint8_t, uint8_t[]);
+    // Column is relative to the visible window, even while the display is shifted
     void setCursor(uint8_t, uint8_t);
     virtual size_t write(uint8_t);
     void command(uint8_t);
@@ -91,7 +91,7 @@ enum class BounceType{Bounce, Loop, None};
         }
         Print::print(val);
         if (timeout > 0) {
-            displayTimeout_ = millis() + timeout;
+            setTimeout(timeout);
         }
     }
 
@@ -106,10 +106,21 @@ enum class BounceType{Bounce, Loop, None};
         print(val);
     }
     void setPersistentStrings(const __FlashStringHelper* upper, const __FlashStringHelper* lower);
-    void setTimeout(unsigned long value);
-    void displayLoop();
+    // Show the persistent strings again after `timeout` ms
+    void setTimeout(uint16_t timeout);
     void shiftBounceType();
+    void setBounceType(BounceType type);
     BounceType getBounceType();
+    // One frame of the persistent string animation, run by the marquee timer
+    void marqueeStep();
+    // Display and marquee off while the USB bus is suspended, the content stays in DDRAM
+    void suspend();
+    void resume();
+    // Changes whenever the screen content is wiped or redrawn as a whole, or touched
+    uint8_t generation() const;
+    // Bumps generation() after a partial write that copies of the screen kept elsewhere
+    // (Diag, BarGraph) would otherwise miss
+    void touch();
 
     using Print::write;
 
@@ -117,23 +128,33 @@ private:
     class BouncyStr
     {
     public:
-    
         BouncyStr(int row);
         void bounce();
         void set(const __FlashStringHelper* val);
         void reset();
+        // Write the whole 40-column DDRAM line, used for hardware scrolling
+        void fill();
+        int length() const;
 
     private:
         void display();
+        char charAt(int pos) const;
 
         int row_ = 0;
-        char str_[64];
+        const char* str_ = nullptr; // PROGMEM
         int idx_ = 0;
         int dir_ = 1;
         int len_ = 0;
-        unsigned long bounceTime_ = 0;
     };
 
+    static void onInitStep();
+    static void onDisplayTimeout();
+    static void onMarqueeStep();
+
+    void initStep();
+    void showPersistent();
+    bool canScrollHardware() const;
+    void scrollStep();
     void flushPins();
 
     void send(uint8_t, uint8_t);
@@ -153,7 +174,20 @@ private:
     uint8_t clockPin_;
     uint8_t dataPin_;
 
-    unsigned long displayTimeout_ = 0;
+    uint8_t cursorRow_ = 0;
+    uint8_t cursorCol_ = 0; // DDRAM column the next write goes to
+    uint8_t shift_ = 0;     // DDRAM column shown in the leftmost cell
+
+    bool scrollHardware_ = false;
+    int scrollDir_ = 1;
+
+    uint8_t generation_ = 0;
+    timers::Handle displayTimer_ = timers::none;
+    timers::Handle marqueeTimer_ = timers::none;
+    timers::Handle initTimer_ = timers::none;
+    bool ready_ = false;
+    bool suspended_ = false;
+    uint8_t initStep_ = 0;
     BouncyStr upper_{0};
     BouncyStr lower_{1};
     BounceType bounceType_ = BounceType::Loop;
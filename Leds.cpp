@@ -1,5 +1,6 @@
 #include "Leds.h"
 #include "Settings.h"
+#include "Timers.h"
 
 #include <Arduino.h>
 #include <array>
@@ -19,16 +20,55 @@ int ledAnimationLength = 0;
 int ledAnimationTimeout = 0;
 
 int persistentLedValue = 0;
-} // namespace
+// What the shift register holds, -1 until the first write
+int appliedLedValue = -1;
+// The value the LEDs would show if not suspended
+int shownLedValue = 0;
+bool ledsSuspended = false;
+
+timers::Handle ledTimer = timers::none;
+timers::Handle randomTimer = timers::none;
 
-unsigned long ledTimeout = 0;
-unsigned long randomTimeout = 0;
+void restoreLeds()
+{
+    // The running animation re-arms the timer with each frame
+    if (ledAnimationTimeout) {
+        return;
+    }
+    setLeds(persistentLedValue, 0);
+}
+
+void shiftLeds(int value)
+{
+    shownLedValue = value;
+    if (ledsSuspended) {
+        value = 0;
+    }
+    if (value == appliedLedValue) {
+        return;
+    }
+    appliedLedValue = value;
+    digitalWrite(pins::ledsLatch, LOW);
+    shiftOut(pins::ledsData, pins::ledsClock, LSBFIRST, value);
+    digitalWrite(pins::ledsLatch, HIGH);
+}
+
+void randomLeds()
+{
+    if (settings.randomLeds && !ledTimeoutActive()) {
+        setLeds(rand() % 255, 0);
+    }
+}
+} // namespace
 
 void setupLeds()
 {
     pinMode(pins::ledsClock, OUTPUT);
     pinMode(pins::ledsData, OUTPUT);
     pinMode(pins::ledsLatch, OUTPUT);
+    ledTimer = timers::create(&restoreLeds, F("led timeout"));
+    randomTimer = timers::create(&randomLeds, F("random leds"));
+    timers::every(randomTimer, 1000);
 }
 
 void setLedAnimation(std::array<int, 8> animation, int length, int timeout)
@@ -50,35 +90,49 @@ void setLeds(int value, int timeout)
     if (!settings.ledsEnabled) {
         value = 0;
     }
-    pinMode(pins::ledsClock, OUTPUT);
-    pinMode(pins::ledsData, OUTPUT);
-    pinMode(pins::ledsLatch, OUTPUT);
-
-    digitalWrite(pins::ledsLatch, LOW);
-    shiftOut(pins::ledsData, pins::ledsClock, LSBFIRST, value);
-    digitalWrite(pins::ledsLatch, HIGH);
+    shiftLeds(value);
     if (timeout) {
-        ledTimeout = millis() + timeout;
+        timers::start(ledTimer, timeout);
     } else {
-        persistentLedValue = value;
-        ledTimeout = 0;
+        timers::cancel(ledTimer);
+    }
+}
+
+void setLockLeds(uint8_t value)
+{
+    persistentLedValue = value;
+    refreshLeds();
+}
+
+void refreshLeds()
+{
+    if (!settings.randomLeds && !ledTimeoutActive()) {
+        setLeds(persistentLedValue, 0);
     }
 }
 
+void suspendLeds(bool suspended)
+{
+    ledsSuspended = suspended;
+    shiftLeds(shownLedValue);
+}
+
+bool ledTimeoutActive()
+{
+    return ledAnimationTimeout || timers::active(ledTimer);
+}
+
 void blinkLed()
 {
-    if (ledAnimationTimeout) {
-        if (ledAnimationCounter >= ledAnimationLength) {
-            ledAnimationTimeout = 0;
-            return;
-        }
-        setLeds(ledAnimation[ledAnimationCounter++], ledAnimationTimeout);
+    if (!ledAnimationTimeout) {
         return;
     }
-    if (ledTimeout == 0 && settings.randomLeds && randomTimeout < millis()) {
-        setLeds(rand() % 255, 0);
-        randomTimeout = millis() + 1000;
-    } else if (ledTimeout && ledTimeout < millis()) {
-        setLeds(persistentLedValue, 0);
+    if (ledAnimationCounter >= ledAnimationLength) {
+        ledAnimationTimeout = 0;
+        if (!timers::active(ledTimer)) {
+            setLeds(persistentLedValue, 0);
+        }
+        return;
     }
+    setLeds(ledAnimation[ledAnimationCounter++], ledAnimationTimeout);
 }
@@ -1,12 +1,20 @@
 #pragma once
 #include <ArduinoSTL.h>
+#include <inttypes.h>
 #include <array>
 
-extern unsigned long ledTimeout;
-
 extern "C" {
     void setupLeds();
+    // Shows `value`, for `timeout` ms or, with 0, until the next change
     void setLeds(int value, int timeout);
+    // Lock LED bits from the host, shown whenever nothing else is
+    void setLockLeds(uint8_t value);
+    // Back to the lock LEDs, after the settings changed
+    void refreshLeds();
+    // While suspended the shift register holds 0 whatever is set, resuming restores it
+    void suspendLeds(bool suspended);
     void setLedAnimation(std::array<int, 8> animation, int length, int timeout);
     void blinkLed();
+    // A timed value or animation is shown instead of the persistent one
+    bool ledTimeoutActive();
 }
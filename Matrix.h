@@ -0,0 +1,191 @@
+#pragma once
+#include "Queue.h"
+
+#include <Arduino.h>
+
+struct KeyEvent
+{
+    uint8_t key; // row * columns + column
+    bool pressed;
+};
+
+// Smallest unsigned type with a bit per column
+template <uint8_t Cols, bool Byte = (Cols <= 8), bool Word = (Cols <= 16)>
+struct MatrixRow
+{
+    typedef uint32_t type;
+};
+template <uint8_t Cols, bool Word>
+struct MatrixRow<Cols, true, Word>
+{
+    typedef uint8_t type;
+};
+template <uint8_t Cols>
+struct MatrixRow<Cols, false, true>
+{
+    typedef uint16_t type;
+};
+
+// Key matrix with the rows as outputs (driven low one at a time) and pulled-up column
+// inputs. The state is one word per row with a bit per column: a scan reads each row's
+// columns straight from the port registers, XORs the word with the previous one and
+// only walks the bits of the rows that changed.
+template <uint8_t Rows, uint8_t Cols>
+class Matrix
+{
+    static_assert(Cols > 0 && Cols <= 32, "a row word holds at most 32 columns");
+    static_assert(Rows * Cols <= 255, "key indices are uint8_t");
+
+public:
+    typedef typename MatrixRow<Cols>::type Row;
+    static constexpr uint8_t numRows = Rows;
+    static constexpr uint8_t numCols = Cols;
+    static constexpr uint8_t numKeys = Rows * Cols;
+
+    Matrix(const uint8_t (&rowPins)[Rows], const uint8_t (&colPins)[Cols])
+    {
+        for (uint8_t r = 0; r < Rows; ++r) {
+            rowPins_[r] = rowPins[r];
+        }
+        for (uint8_t c = 0; c < Cols; ++c) {
+            colPins_[c] = colPins[c];
+        }
+    }
+
+    void begin()
+    {
+        for (uint8_t r = 0; r < Rows; ++r) {
+            pinMode(rowPins_[r], INPUT);
+            uint8_t port = digitalPinToPort(rowPins_[r]);
+            rowModes_[r] = portModeRegister(port);
+            rowMasks_[r] = digitalPinToBitMask(rowPins_[r]);
+        }
+        numPorts_ = 0;
+        for (uint8_t c = 0; c < Cols; ++c) {
+            pinMode(colPins_[c], INPUT_PULLUP);
+            Register input = portInputRegister(digitalPinToPort(colPins_[c]));
+            uint8_t p = 0;
+            while (p < numPorts_ && portInputs_[p] != input) {
+                ++p;
+            }
+            if (p == numPorts_) {
+                portInputs_[numPorts_++] = input;
+            }
+            colPorts_[c] = p;
+            colMasks_[c] = digitalPinToBitMask(colPins_[c]);
+        }
+    }
+
+    // Queues an event per changed key. An edge that doesn't fit into the queue is left
+    // unapplied and shows up again on the next scan. Returns true while any key is held.
+    template <uint8_t N>
+    bool scan(Queue<KeyEvent, N>& events)
+    {
+        bool held = false;
+        for (uint8_t r = 0; r < Rows; ++r) {
+            *rowModes_[r] |= rowMasks_[r];
+            delayMicroseconds(settleMicros);
+            Row now = readColumns();
+            *rowModes_[r] &= ~rowMasks_[r];
+
+            held |= now != 0;
+            for (Row changed = state_[r] ^ now; changed; changed &= changed - 1) {
+                Row bit = changed & -changed;
+                if (!events.push({static_cast<uint8_t>(r * Cols + bitIndex(bit)), (now & bit) != 0})) {
+                    return true;
+                }
+                state_[r] ^= bit;
+            }
+        }
+        return held;
+    }
+
+    bool pressed(uint8_t key) const
+    {
+        return state_[key / Cols] & (Row(1) << (key % Cols));
+    }
+
+    Row row(uint8_t r) const
+    {
+        return state_[r];
+    }
+
+    // Key bitmask, bit N of the little-endian byte array is key N
+    void pack(uint8_t (&keys)[(numKeys + 7) / 8]) const
+    {
+        for (auto& byte : keys) {
+            byte = 0;
+        }
+        for (uint8_t r = 0; r < Rows; ++r) {
+            for (Row bits = state_[r]; bits; bits &= bits - 1) {
+                uint8_t key = r * Cols + bitIndex(bits & -bits);
+                keys[key / 8] |= 1 << (key % 8);
+            }
+        }
+    }
+
+    // All rows low: any key pulls its column down, probe() is one read per column
+    void enterIdle()
+    {
+        for (uint8_t r = 0; r < Rows; ++r) {
+            *rowModes_[r] |= rowMasks_[r];
+        }
+    }
+
+    void leaveIdle()
+    {
+        for (uint8_t r = 0; r < Rows; ++r) {
+            *rowModes_[r] &= ~rowMasks_[r];
+        }
+    }
+
+    bool probe() const
+    {
+        return readColumns() != 0;
+    }
+
+private:
+    typedef decltype(portInputRegister(0)) Register;
+
+    // Let the column lines settle after a row is selected
+    static constexpr uint8_t settleMicros = 1;
+
+    static uint8_t bitIndex(Row bit)
+    {
+        uint8_t index = 0;
+        while (bit >>= 1) {
+            ++index;
+        }
+        return index;
+    }
+
+    // Bit set for every column pulled low. Each port is read once, so the columns are
+    // sampled together. The bits are then picked one column at a time: the board's
+    // columns are PF7..PF4 in reverse order, which no shift of the port value lines up.
+    Row readColumns() const
+    {
+        uint8_t low[Cols];
+        for (uint8_t p = 0; p < numPorts_; ++p) {
+            low[p] = ~*portInputs_[p];
+        }
+        Row bits = 0;
+        Row bit = 1;
+        for (uint8_t c = 0; c < Cols; ++c, bit <<= 1) {
+            if (low[colPorts_[c]] & colMasks_[c]) {
+                bits |= bit;
+            }
+        }
+        return bits;
+    }
+
+    uint8_t rowPins_[Rows];
+    uint8_t colPins_[Cols];
+    Register rowModes_[Rows];
+    uint8_t rowMasks_[Rows];
+    // The distinct input registers of the columns, and per column its port and bit
+    Register portInputs_[Cols];
+    uint8_t numPorts_ = 0;
+    uint8_t colPorts_[Cols];
+    uint8_t colMasks_[Cols];
+    Row state_[Rows] = {};
+};
@@ -28,9 +28,8 @@ public:
     void Init()
     {
 #ifdef USE_SERIAL
+        // Don't wait for a terminal, the CDC port drops output until one attaches
         Serial.begin(115200);
-        while (!Serial)
-            ; // Wait untilSerial is ready - Leonardo
 #endif
     }
     Cout& operator<<(Endl&)
@@ -47,8 +46,8 @@ public:
     {
 #ifdef USE_SERIAL
         mode = Mode::Hex;
-        return *this;
 #endif
+        return *this;
     }
     Cout& operator<<(Dec&)
     {
@@ -0,0 +1,35 @@
+#pragma once
+#include <inttypes.h>
+
+// Cycle count markers for the simavr harness in sim/. A build with -DSIM_PROFILE writes
+// the marker id to GPIOR0, where the driver timestamps it with the simulated cycle
+// counter. In normal builds the markers compile to nothing.
+#ifdef SIM_PROFILE
+#include <avr/io.h>
+#define PROFILE_MARK(id) (GPIOR0 = (id))
+#else
+#define PROFILE_MARK(id) ((void)0)
+#endif
+
+namespace profile
+{
+// Begin markers, the matching end marker is the id + 1
+enum : uint8_t { Scan = 1, Isr = 3, Loop = 5, IrIsr = 7 };
+
+// Marks the begin of a section on construction and its end on every way out
+class Scope
+{
+public:
+    explicit Scope(uint8_t id) : id_(id)
+    {
+        PROFILE_MARK(id_);
+    }
+    ~Scope()
+    {
+        PROFILE_MARK(id_ + 1);
+    }
+
+private:
+    uint8_t id_;
+};
+} // namespace profile
@@ -0,0 +1,65 @@
+#pragma once
+#include <inttypes.h>
+
+// Fixed-size FIFO for events between the producers in the scan path and their consumers.
+// Keeps the deepest fill level seen, for the diagnostics.
+template <typename T, uint8_t N>
+class Queue
+{
+public:
+    bool push(const T& value)
+    {
+        if (size_ == N) {
+            return false;
+        }
+        items_[(head_ + size_) % N] = value;
+        ++size_;
+        if (size_ > highWater_) {
+            highWater_ = size_;
+        }
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        if (size_ == 0) {
+            return false;
+        }
+        value = items_[head_];
+        head_ = (head_ + 1) % N;
+        --size_;
+        return true;
+    }
+
+    // The `i`th oldest item, i < size()
+    const T& peek(uint8_t i) const
+    {
+        return items_[(head_ + i) % N];
+    }
+
+    uint8_t size() const
+    {
+        return size_;
+    }
+
+    bool full() const
+    {
+        return size_ == N;
+    }
+
+    uint8_t highWater() const
+    {
+        return highWater_;
+    }
+
+    void resetHighWater()
+    {
+        highWater_ = size_;
+    }
+
+private:
+    T items_[N];
+    uint8_t head_ = 0;
+    uint8_t size_ = 0;
+    uint8_t highWater_ = 0;
+};
@@ -12,4 +12,25 @@ struct Settings
     bool lcdEnabled = true;
     bool irEnabled = true;
     bool randomLeds = false;
+    bool traceRecord = false;
+    // Quiet time in ms before the matrix drops to the idle probe, 0 keeps full scanning
+    unsigned int idleTimeout = 5000;
+    // Edges of a key within this many ms of its last reported edge are bounce
+    unsigned int debounce = 5;
+    // Dual-role keys pressed longer than this many ms act as their hold action
+    unsigned int tappingTerm = 200;
+    // What else settles a dual-role key as held before the tapping term ends:
+    // 0 nothing, 1 another key pressed and released (permissive hold),
+    // 2 another key pressed (hold on other key press)
+    unsigned int tapHoldMode = 1;
+    // What the encoder does on layer 0 and on layer 1: 0 volume, 1 wheel, 2 horizontal pan
+    unsigned int encoderMode = 0;
+    unsigned int encoderFnMode = 1;
+    // A loop pass longer than this many ms is logged as a stall, see Watchdog.h. Rounded
+    // up to a watchdog period, 16 ms to 8 s, 0 turns the watchdog off.
+    unsigned int stallBudget = 250;
+    // Matrix scans: 0 every ms from the timer, 1 once per USB frame, starting scanLead us
+    // before the next start of frame, see FrameSync.h
+    unsigned int scanSync = 0;
+    unsigned int scanLead = 300;
 };
@@ -0,0 +1,108 @@
+#include "Storage.h"
+#include "Settings.h"
+#include "Keyboard.h"
+#include "Health.h"
+#include "Keymap.h"
+#include "Tick.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+
+namespace
+{
+constexpr uint32_t saveInterval = 15UL * 60 * 1000;
+
+// A layout change invalidates the stored image and the defaults are used instead
+struct Header
+{
+    uint16_t magic;
+    uint8_t settingsSize;
+    uint8_t keys;
+};
+constexpr uint16_t magic = 0x4B54;
+
+constexpr uint16_t settingsOffset = sizeof(Header);
+constexpr uint16_t healthOffset = settingsOffset + sizeof(Settings);
+// keyCount() is keymap::keys, see Keyboard.cpp
+static_assert(healthOffset + keymap::keys * sizeof(KeyHealth) <= keymap::bankBase,
+    "settings and key health run into the keymap banks");
+
+bool saving = false;
+uint16_t cursor = 0;
+uint32_t nextSave = 0;
+
+Header header()
+{
+    return {magic, sizeof(Settings), static_cast<uint8_t>(keyCount())};
+}
+
+uint16_t imageSize()
+{
+    return healthOffset + keyCount() * sizeof(KeyHealth);
+}
+
+// Byte `offset` of what the EEPROM should hold, read from the live values
+uint8_t imageByte(uint16_t offset)
+{
+    if (offset < settingsOffset) {
+        Header head = header();
+        return reinterpret_cast<const uint8_t*>(&head)[offset];
+    }
+    if (offset < healthOffset) {
+        return reinterpret_cast<const uint8_t*>(&settings)[offset - settingsOffset];
+    }
+    offset -= healthOffset;
+    return reinterpret_cast<const uint8_t*>(&keyHealth(offset / sizeof(KeyHealth)))
+        [offset % sizeof(KeyHealth)];
+}
+} // namespace
+
+void loadSettings()
+{
+    nextSave = tick::now() + saveInterval;
+    Header stored;
+    EEPROM.get(0, stored);
+    Header expected = header();
+    if (memcmp(&stored, &expected, sizeof(Header)) != 0) {
+        return;
+    }
+    EEPROM.get(settingsOffset, settings);
+    // Recording only ever starts from the console or the Fn layer
+    settings.traceRecord = false;
+    for (int idx = 0; idx < keyCount(); ++idx) {
+        EEPROM.get(healthOffset + idx * sizeof(KeyHealth), keyHealth(idx));
+    }
+}
+
+void saveSettings()
+{
+    nextSave = tick::now();
+}
+
+void pollStorage()
+{
+    if (!saving) {
+        if (!tick::reached(nextSave)) {
+            return;
+        }
+        saving = true;
+        cursor = 0;
+    }
+    // Skip ahead over unchanged bytes, reads are cheap, then start at most one write.
+    // The header goes last so an interrupted first save is not taken for a valid image.
+    uint16_t size = imageSize();
+    while (cursor < size && eeprom_is_ready()) {
+        uint16_t offset = (cursor + settingsOffset) % size;
+        uint8_t value = imageByte(offset);
+        ++cursor;
+        if (EEPROM.read(offset) != value) {
+            EEPROM.write(offset, value);
+            return;
+        }
+    }
+    if (cursor >= size) {
+        saving = false;
+        nextSave = tick::now() + saveInterval;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Settings and the per-key health totals in EEPROM. loadSettings() runs once at boot,
+// after that pollStorage() copies the live values back every few minutes. A save writes
+// at most one byte per call and only bytes that changed, so it never waits for the
+// 3.3 ms EEPROM write cycle and barely wears the cells.
+extern "C" {
+void loadSettings();
+// Start a save right away instead of at the next periodic checkpoint
+void saveSettings();
+void pollStorage();
+}
@@ -0,0 +1,21 @@
+#include "Tick.h"
+
+#include <Arduino.h>
+
+namespace
+{
+uint32_t current = 0;
+} // namespace
+
+namespace tick
+{
+void update()
+{
+    current = millis();
+}
+
+uint32_t now()
+{
+    return current;
+}
+} // namespace tick
@@ -0,0 +1,16 @@
+#pragma once
+#include <inttypes.h>
+
+// Millisecond time sampled once per loop pass. Modules read tick::now() instead of calling
+// millis() again, and compare against deadlines with reached(), which survives the
+// 49-day wraparound.
+namespace tick
+{
+void update();
+uint32_t now();
+
+inline bool reached(uint32_t deadline)
+{
+    return static_cast<int32_t>(now() - deadline) >= 0;
+}
+} // namespace tick
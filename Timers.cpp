@@ -0,0 +1,192 @@
+#include "Timers.h"
+#include "Tick.h"
+
+#include <Arduino.h>
+
+namespace
+{
+constexpr uint8_t poolSize = 20;
+// Power of two, so the bucket is the low bits of the expiry tick
+constexpr uint8_t wheelSize = 32;
+
+enum class State : uint8_t { Idle, Linked, Due };
+
+// Links are pool index + 1, so zero-initialized buckets are empty
+struct Timer
+{
+    timers::Callback callback;
+    const __FlashStringHelper* name;
+    timers::Stats stats;
+    uint32_t expires;
+    uint16_t interval;
+    uint8_t prev;
+    uint8_t next;
+    State state;
+};
+
+Timer pool[poolSize];
+uint8_t used = 0;
+uint8_t buckets[wheelSize];
+uint32_t lastRun = 0;
+volatile timers::Handle current = timers::none;
+
+void link(timers::Handle timer)
+{
+    Timer& t = pool[timer];
+    uint8_t& head = buckets[t.expires & (wheelSize - 1)];
+    t.prev = 0;
+    t.next = head;
+    if (head) {
+        pool[head - 1].prev = timer + 1;
+    }
+    head = timer + 1;
+    t.state = State::Linked;
+}
+
+void unlink(timers::Handle timer)
+{
+    Timer& t = pool[timer];
+    if (t.prev) {
+        pool[t.prev - 1].next = t.next;
+    } else {
+        buckets[t.expires & (wheelSize - 1)] = t.next;
+    }
+    if (t.next) {
+        pool[t.next - 1].prev = t.prev;
+    }
+    t.state = State::Idle;
+}
+
+void schedule(timers::Handle timer, uint16_t delay, uint16_t interval)
+{
+    if (timer >= used) {
+        return;
+    }
+    if (pool[timer].state == State::Linked) {
+        unlink(timer);
+    }
+    // A zero delay would land in a bucket this tick's run() has already passed
+    pool[timer].expires = tick::now() + (delay > 0 ? delay : 1);
+    pool[timer].interval = interval;
+    link(timer);
+}
+} // namespace
+
+namespace timers
+{
+Handle create(Callback callback, const __FlashStringHelper* name)
+{
+    if (used >= poolSize) {
+        return none;
+    }
+    pool[used].callback = callback;
+    pool[used].name = name;
+    pool[used].state = State::Idle;
+    return used++;
+}
+
+void start(Handle timer, uint16_t delay)
+{
+    schedule(timer, delay, 0);
+}
+
+void every(Handle timer, uint16_t interval)
+{
+    schedule(timer, interval, interval);
+}
+
+void cancel(Handle timer)
+{
+    if (timer >= used) {
+        return;
+    }
+    if (pool[timer].state == State::Linked) {
+        unlink(timer);
+    }
+    pool[timer].state = State::Idle;
+}
+
+bool active(Handle timer)
+{
+    return timer < used && pool[timer].state != State::Idle;
+}
+
+void run()
+{
+    uint32_t now = tick::now();
+    uint32_t ticks = now - lastRun;
+    if (ticks == 0) {
+        return;
+    }
+    // After a stall longer than a revolution every bucket is visited once
+    if (ticks > wheelSize) {
+        ticks = wheelSize;
+    }
+
+    // Collect first, the callbacks may start or cancel any timer
+    Handle due[poolSize];
+    uint8_t dueCount = 0;
+    for (uint32_t t = now - ticks + 1; ticks > 0; ++t, --ticks) {
+        uint8_t next = buckets[t & (wheelSize - 1)];
+        while (next) {
+            Handle timer = next - 1;
+            next = pool[timer].next;
+            if (tick::reached(pool[timer].expires)) {
+                unlink(timer);
+                pool[timer].state = State::Due;
+                due[dueCount++] = timer;
+            }
+        }
+    }
+    lastRun = now;
+
+    for (uint8_t i = 0; i < dueCount; ++i) {
+        Timer& t = pool[due[i]];
+        if (t.state != State::Due) {
+            continue;
+        }
+        t.state = State::Idle;
+        if (t.interval > 0) {
+            t.expires = now + t.interval;
+            link(due[i]);
+        }
+        uint32_t begin = micros();
+        current = due[i];
+        t.callback();
+        current = none;
+        uint32_t spent = micros() - begin;
+        ++t.stats.runs;
+        t.stats.totalMicros += spent;
+        if (spent > t.stats.maxMicros) {
+            t.stats.maxMicros = spent > 0xFFFF ? 0xFFFF : spent;
+        }
+    }
+}
+
+Handle running()
+{
+    return current;
+}
+
+uint8_t count()
+{
+    return used;
+}
+
+const __FlashStringHelper* name(Handle timer)
+{
+    return timer < used ? pool[timer].name : nullptr;
+}
+
+const Stats& stats(Handle timer)
+{
+    return pool[timer < used ? timer : 0].stats;
+}
+
+void resetStats()
+{
+    for (uint8_t i = 0; i < used; ++i) {
+        pool[i].stats = {};
+    }
+}
+} // namespace timers
@@ -0,0 +1,40 @@
+#pragma once
+#include <inttypes.h>
+
+class __FlashStringHelper;
+
+// One-shot and periodic callbacks on a hashed timer wheel driven by tick::now().
+// Timers come from a fixed pool and are bound to their callback once, usually in a
+// setup function. Starting and cancelling is O(1), run() only visits the buckets of the
+// milliseconds that passed since the previous pass.
+namespace timers
+{
+typedef void (*Callback)();
+typedef uint8_t Handle;
+constexpr Handle none = 0xFF;
+
+// Time spent in a timer's callback, for the profiler dump
+struct Stats
+{
+    uint32_t runs;
+    uint32_t totalMicros;
+    uint16_t maxMicros;
+};
+
+Handle create(Callback callback, const __FlashStringHelper* name = nullptr);
+// One-shot, fires once `delay` ms from now. Restarts the timer if it is already running.
+void start(Handle timer, uint16_t delay);
+// Periodic, fires every `interval` ms starting `interval` ms from now
+void every(Handle timer, uint16_t interval);
+void cancel(Handle timer);
+bool active(Handle timer);
+
+void run();
+// Timer whose callback is running, none between callbacks. Safe to read from an ISR.
+Handle running();
+
+uint8_t count();
+const __FlashStringHelper* name(Handle timer);
+const Stats& stats(Handle timer);
+void resetStats();
+} // namespace timers
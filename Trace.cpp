@@ -0,0 +1,130 @@
+#include "Trace.h"
+#include "Settings.h"
+#include "Tick.h"
+
+#include <Arduino.h>
+
+namespace
+{
+// Lines wait here until the console sends them, a full buffer drops new lines
+char buffer[128];
+uint8_t head = 0;
+uint8_t tail = 0;
+uint16_t dropped = 0;
+
+// Packed key state as passed to traceMatrix(), key N is bit N % 8 of byte N / 8
+uint8_t lastKeys[16] = {};
+uint8_t keyBytes = 1;
+volatile int8_t encoderDelta = 0;
+
+uint8_t used()
+{
+    return static_cast<uint8_t>(head - tail) % sizeof(buffer);
+}
+
+void push(const char* line, int len)
+{
+    if (len <= 0 || len >= static_cast<int>(sizeof(buffer) - used())) {
+        ++dropped;
+        return;
+    }
+    for (int i = 0; i < len; ++i) {
+        buffer[head] = line[i];
+        head = (head + 1) % sizeof(buffer);
+    }
+}
+
+// "<ms> M <keys>\n" with the keys as one hex number, most significant byte first
+int formatKeys(char* line, size_t size)
+{
+    int len = snprintf_P(line, size, PSTR("%lu M "), static_cast<unsigned long>(tick::now()));
+    uint8_t i = keyBytes;
+    while (i > 1 && lastKeys[i - 1] == 0) {
+        --i;
+    }
+    len += snprintf_P(line + len, size - len, PSTR("%x"), lastKeys[--i]);
+    while (i > 0 && len < static_cast<int>(size)) {
+        len += snprintf_P(line + len, size - len, PSTR("%02x"), lastKeys[--i]);
+    }
+    if (len < static_cast<int>(size) - 1) {
+        line[len++] = '\n';
+        line[len] = '\0';
+    }
+    return len;
+}
+} // namespace
+
+void startTrace()
+{
+    Serial.begin(115200);
+    head = tail = 0;
+    dropped = 0;
+    encoderDelta = 0;
+    char line[48];
+    push(line, snprintf_P(line, sizeof(line), PSTR("# trace v1\n")));
+    push(line, formatKeys(line, sizeof(line)));
+}
+
+void traceMatrix(const uint8_t* keys, uint8_t bytes)
+{
+    if (bytes > sizeof(lastKeys)) {
+        bytes = sizeof(lastKeys);
+    }
+    if (bytes == keyBytes && memcmp(keys, lastKeys, bytes) == 0) {
+        return;
+    }
+    memcpy(lastKeys, keys, bytes);
+    keyBytes = bytes;
+    if (!settings.traceRecord) {
+        return;
+    }
+    char line[48];
+    push(line, formatKeys(line, sizeof(line)));
+}
+
+// Called from encoderISR(), pollTrace() turns the sum into a line
+void traceEncoder(int8_t delta)
+{
+    encoderDelta += delta;
+}
+
+void traceIr(uint16_t address, uint16_t command, uint8_t flags)
+{
+    if (!settings.traceRecord) {
+        return;
+    }
+    char line[32];
+    push(line, snprintf_P(line, sizeof(line), PSTR("%lu I %x %x %x\n"),
+                   static_cast<unsigned long>(tick::now()), address, command, flags));
+}
+
+void pollTrace()
+{
+    if (!settings.traceRecord) {
+        return;
+    }
+    noInterrupts();
+    int8_t delta = encoderDelta;
+    encoderDelta = 0;
+    interrupts();
+    char line[24];
+    if (delta != 0) {
+        push(line, snprintf_P(line, sizeof(line), PSTR("%lu E %d\n"),
+                       static_cast<unsigned long>(tick::now()), delta));
+    }
+    if (dropped > 0 && sizeof(buffer) - used() > 16) {
+        uint16_t count = dropped;
+        dropped = 0;
+        push(line, snprintf_P(line, sizeof(line), PSTR("# dropped %u\n"), count));
+    }
+}
+
+int traceRead()
+{
+    if (tail == head) {
+        return -1;
+    }
+    uint8_t c = buffer[tail];
+    tail = (tail + 1) % sizeof(buffer);
+    return c;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <inttypes.h>
+
+// Raw input trace streamed over serial while settings.traceRecord is on, and fed back
+// through the firmware by host/replay. One event per line, times in ms, numbers in hex:
+//   <ms> M <keys>               raw matrix state, bit N set while key N is down
+//   <ms> E <detents>            encoder motion since the previous E line (decimal)
+//   <ms> I <addr> <cmd> <flags> decoded IR frame
+// Lines starting with '#' are comments.
+
+extern "C" {
+void startTrace();
+void traceMatrix(const uint8_t* keys, uint8_t bytes);
+void traceEncoder(int8_t delta);
+void traceIr(uint16_t address, uint16_t command, uint8_t flags);
+void pollTrace();
+// Next byte of the queued lines, -1 when there is none. pollConsole() owns the serial
+// port and sends them between its replies.
+int traceRead();
+}
@@ -2,8 +2,15 @@
 #include "Out.h"
 #include "Leds.h"
 #include "LCD.h"
+#include "BarGraph.h"
+#include "Trace.h"
+#include "Hid.h"
+#include "Profile.h"
+#include "Input.h"
+#include "Keymap.h"
+#include "Tick.h"
+#include "Settings.h"
 #include <Arduino.h>
-#include <MultiReport/Consumer.h>
 
 namespace
 {
@@ -18,7 +25,28 @@ volatile double targetVolume = 0.0;
 double minVolume = 0.0;
 int ups = 0;
 int downs = 0;
+BarGraph volumeBar(0, 0, 16);
+// Detents counted by encoderISR() since the last pollEncoder()
+volatile int8_t detents = 0;
 
+// Each 0.02 step towards the target is a volume key press, its release a call later and
+// a call of rest, so a long turn never holds up the loop
+enum class Step : uint8_t { Idle, Pressed, Released };
+Step step = Step::Idle;
+ConsumerKeycode stepKey = MEDIA_VOLUME_UP;
+
+// One detent's action in the encoder mode of the active layer
+uint16_t encoderAction(bool up)
+{
+    switch (input::layer() == 0 ? settings.encoderMode : settings.encoderFnMode) {
+        case 1:
+            return action::scroll(up ? 1 : -1, false);
+        case 2:
+            return action::scroll(up ? 1 : -1, true);
+        default:
+            return action::make(action::Command, up ? action::VolumeUp : action::VolumeDown);
+    }
+}
 } // namespace
 
 void encoderISR();
@@ -32,72 +60,78 @@ void setupVolume()
     attachInterrupt(digitalPinToInterrupt(pins::encoderA), encoderISR, CHANGE);
 }
 
-void changeVolume(ConsumerKeycode val)
-{
-    Consumer.press(val);
-    delay(10);
-    Consumer.release(val);
-    delay(10);
-}
-
 void checkVolume()
 {
-    double deltaVolume = volumeValue - targetVolume;
-    int steps = fabs(deltaVolume) / 0.02;
-    while (fabs(volumeValue - targetVolume) > 0.01) {
-        out::cout << F("From ") << volumeValue << F(" To ") << targetVolume;
-        if (volumeValue < targetVolume) {
-            changeVolume(MEDIA_VOLUME_UP);
-            downs = 0;
-            ++ups;
-            out::cout << F(" Up ") << ups << out::endl;
-            volumeValue += 0.02;
-            delay(10);
-        } else {
-            changeVolume(MEDIA_VOLUME_DOWN);
-            ups = 0;
-            ++downs;
-            out::cout << F(" Down ") << downs << out::endl;
-            volumeValue -= 0.02;
-            delay(10);
-        }
-        if (volumeValue > minVolume + 1.0) {
-            minVolume = volumeValue - 1.0;
-        }
-        if (volumeValue < minVolume) {
-            minVolume = volumeValue;
-        }
-        int ledsValue = 0;
-        int numLeds = sqrt((volumeValue - minVolume)) * 8.0f;
-        for (int i = 0; i < numLeds; ++i) {
-            ledsValue |= 1 << i;
-        }
-        setLeds(ledsValue, 3000);
+    // Finish the step in progress first, one state per call
+    switch (step) {
+        case Step::Pressed:
+            hid::release(stepKey);
+            step = Step::Released;
+            return;
+        case Step::Released:
+            step = Step::Idle;
+            return;
+        default:
+            break;
+    }
+    if (fabs(volumeValue - targetVolume) <= 0.01) {
+        return;
+    }
+    out::cout << F("From ") << volumeValue << F(" To ") << targetVolume;
+    if (volumeValue < targetVolume) {
+        stepKey = MEDIA_VOLUME_UP;
+        downs = 0;
+        ++ups;
+        out::cout << F(" Up ") << ups << out::endl;
+        volumeValue += 0.02;
+    } else {
+        stepKey = MEDIA_VOLUME_DOWN;
+        ups = 0;
+        ++downs;
+        out::cout << F(" Down ") << downs << out::endl;
+        volumeValue -= 0.02;
+    }
+    hid::press(stepKey);
+    step = Step::Pressed;
+    if (volumeValue > minVolume + 1.0) {
+        minVolume = volumeValue - 1.0;
+    }
+    if (volumeValue < minVolume) {
+        minVolume = volumeValue;
+    }
+    int ledsValue = 0;
+    int numLeds = sqrt((volumeValue - minVolume)) * 8.0f;
+    for (int i = 0; i < numLeds; ++i) {
+        ledsValue |= 1 << i;
+    }
+    setLeds(ledsValue, 3000);
 
-        int plainVolume = static_cast<int>((volumeValue - minVolume) * 100.0);
+    int plainVolume = static_cast<int>((volumeValue - minVolume) * 100.0);
+    if (volumeBar.stale()) {
         lcd.clear();
-        lcd.setCursor(0, 0);
-        for (int i=0; i<plainVolume / 6.25;++i) {
-            lcd.print((char)255);
-        }
-        lcd.setCursor(0, 1);
-        lcd.print("Vol: ");
-        lcd.print(plainVolume);
     }
+    volumeBar.set(static_cast<int>((volumeValue - minVolume) * volumeBar.steps() + 0.5));
+    lcd.setCursor(0, 1);
+    lcd.print("Vol: ");
+    lcd.print(plainVolume);
+    lcd.print("  ");
 }
 
 volatile int lastEncoderA = 0;
 void encoderISR()
 {
+    profile::Scope scope(profile::Isr);
     noInterrupts();
     int A = digitalRead(pins::encoderA);
     int B = digitalRead(pins::encoderB);
     if (A != 0 && A != lastEncoderA) {
         if (A == B) {
-            targetVolume += 0.02;
+            ++detents;
+            traceEncoder(1);
             out::cout << F("CW") << out::endl;
         } else {
-            targetVolume -= 0.02;
+            --detents;
+            traceEncoder(-1);
             out::cout << F("CCW") << out::endl;
         }
     }
@@ -108,4 +142,30 @@ void encoderISR()
 void addTargetVolume(float delta)
 {
     targetVolume += delta;
+}
+
+void pollEncoder()
+{
+    // The detents wait for the host, which they wake up
+    if (hid::suspended()) {
+        if (detents != 0) {
+            hid::wakeup();
+        }
+        return;
+    }
+    noInterrupts();
+    int8_t delta = detents;
+    detents = 0;
+    interrupts();
+    if (delta == 0) {
+        return;
+    }
+    bool up = delta > 0;
+    uint16_t act = encoderAction(up);
+    input::Event event = {input::Encoder, static_cast<uint8_t>(up ? 0 : 1), input::Tap,
+        tick::now()};
+    for (int i = 0; i < abs(delta); ++i) {
+        input::execute(event, act);
+    }
+    input::flush();
 }
\ No newline at end of file
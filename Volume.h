@@ -2,6 +2,10 @@
 
 extern "C" {
     void setupVolume();
+    // Every 10 ms, moves the host volume one step towards the target per three calls
     void checkVolume();
     void addTargetVolume(float delta);
+    // Once per USB frame: runs the detents since the previous call through
+    // input::execute(), a turn that scrolls goes out as one wheel or pan report
+    void pollEncoder();
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "Watchdog.h"
+#include "Settings.h"
+#include "Timers.h"
+#include "Tick.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+namespace
+{
+using watchdog::Stall;
+
+// Above the IR code table: the slot the next entry goes to, then the entries
+constexpr uint16_t logBase = 992;
+constexpr uint16_t logEntries = logBase + 1;
+static_assert(logEntries + watchdog::logSize * sizeof(Stall) <= 1024, "stall log past the EEPROM");
+
+// wdt_enable() values, the period is 16 ms << value
+constexpr uint8_t longest = WDTO_8S;
+constexpr uint8_t off = 0xFF;
+
+enum class State : uint8_t { Empty, Open, Closed };
+
+// The stall on its way to the EEPROM: Open until the pass that stalled checks in and
+// its length is known, then Closed while it is written. Not cleared at boot, the magic
+// tells a stall caught before a reset from leftover RAM.
+struct Capture
+{
+    uint16_t magic;
+    State state;
+    uint8_t cursor;
+    Stall stall;
+};
+constexpr uint16_t magic = 0x5744;
+Capture capture __attribute__((section(".noinit")));
+
+uint8_t prescaler = off;
+// Watchdog periods the current pass has run over
+volatile uint8_t overruns = 0;
+// The core arms the watchdog itself to reset into the bootloader, then it is left alone
+bool yielded = false;
+uint32_t lastCheckIn = 0;
+
+uint8_t prescalerFor(unsigned int budget)
+{
+    if (budget == 0) {
+        return off;
+    }
+    uint8_t value = 0;
+    while (value < longest && (16U << value) < budget) {
+        ++value;
+    }
+    return value;
+}
+
+void configure(uint8_t value)
+{
+    noInterrupts();
+    if (value == off) {
+        wdt_disable();
+    } else {
+        // Interrupt and reset mode, WDIE can be set without the timed sequence
+        wdt_enable(value);
+        WDTCSR |= _BV(WDIE);
+    }
+    prescaler = value;
+    overruns = 0;
+    interrupts();
+}
+
+// Runs in the interrupt, once per watchdog period the pass runs over
+void caught(uint16_t pc)
+{
+    if (overruns == 0 && capture.magic != magic) {
+        capture.stall = {static_cast<uint32_t>(millis()), pc, 0, timers::running(), false};
+        capture.state = State::Open;
+        capture.magic = magic;
+    }
+    ++overruns;
+    // The hardware cleared WDIE, without it the next timeout resets the board
+    if (overruns * (16U << prescaler) < watchdog::resetAfter) {
+        WDTCSR |= _BV(WDIE);
+    }
+}
+
+uint16_t slotAddress(uint8_t slot)
+{
+    return logEntries + slot * sizeof(Stall);
+}
+
+// One byte per call at most and only bytes that changed, the next slot goes last
+void writeLog()
+{
+    if (!eeprom_is_ready()) {
+        return;
+    }
+    uint8_t slot = EEPROM.read(logBase) % watchdog::logSize;
+    auto bytes = reinterpret_cast<const uint8_t*>(&capture.stall);
+    while (capture.cursor < sizeof(Stall)) {
+        uint16_t address = slotAddress(slot) + capture.cursor;
+        uint8_t value = bytes[capture.cursor++];
+        if (EEPROM.read(address) != value) {
+            EEPROM.write(address, value);
+            return;
+        }
+    }
+    EEPROM.write(logBase, (slot + 1) % watchdog::logSize);
+    capture.state = State::Empty;
+    capture.magic = 0;
+}
+} // namespace
+
+#ifdef __AVR__
+extern "C" void watchdogStall() __attribute__((signal, used));
+// Interrupted program counter, as a word address with the high byte first
+volatile uint8_t stallPc[2] asm("watchdog_stall_pc") __attribute__((used));
+
+// Picks the return address off the stack before a normal handler prologue buries it
+// under an unknown number of saved registers: three pushes, then the PC the interrupt
+// pushed, high byte first. Nothing here touches SREG.
+ISR(WDT_vect, ISR_NAKED)
+{
+    asm volatile("push r29\n\t"
+                 "push r30\n\t"
+                 "push r31\n\t"
+                 "in r30, __SP_L__\n\t"
+                 "in r31, __SP_H__\n\t"
+                 "ldd r29, Z+4\n\t"
+                 "sts watchdog_stall_pc, r29\n\t"
+                 "ldd r29, Z+5\n\t"
+                 "sts watchdog_stall_pc+1, r29\n\t"
+                 "pop r31\n\t"
+                 "pop r30\n\t"
+                 "pop r29\n\t"
+                 "jmp watchdogStall\n\t");
+}
+
+void watchdogStall()
+{
+    caught((stallPc[0] << 8 | stallPc[1]) * 2);
+}
+#else
+// Host builds have no flash addresses to report
+ISR(WDT_vect)
+{
+    caught(0);
+}
+#endif
+
+namespace watchdog
+{
+void begin()
+{
+    if (capture.magic == magic && capture.state == State::Open) {
+        // The pass that stalled never checked in again
+        capture.stall.reset = true;
+        capture.stall.length = 0xFFFF;
+        capture.state = State::Closed;
+    } else if (capture.magic != magic || capture.state != State::Closed) {
+        capture.magic = 0;
+        capture.state = State::Empty;
+    }
+    capture.cursor = 0;
+    lastCheckIn = tick::now();
+    configure(prescalerFor(settings.stallBudget));
+}
+
+void checkIn()
+{
+    if (yielded) {
+        return;
+    }
+    uint32_t now = tick::now();
+    if (prescaler != off) {
+        noInterrupts();
+        uint8_t stalled = overruns;
+        if (stalled == 0 && !(WDTCSR & _BV(WDIE))) {
+            interrupts();
+            yielded = true;
+            return;
+        }
+        wdt_reset();
+        overruns = 0;
+        if (stalled > 0) {
+            WDTCSR |= _BV(WDIE);
+        }
+        interrupts();
+        if (stalled > 0 && capture.state == State::Open) {
+            uint32_t length = now - lastCheckIn;
+            capture.stall.length = length > 0xFFFF ? 0xFFFF : length;
+            capture.state = State::Closed;
+            capture.cursor = 0;
+        }
+    }
+    lastCheckIn = now;
+    if (prescalerFor(settings.stallBudget) != prescaler) {
+        configure(prescalerFor(settings.stallBudget));
+    }
+    if (capture.state == State::Closed) {
+        writeLog();
+    }
+}
+
+bool entry(uint8_t index, Stall& stall)
+{
+    if (index >= logSize) {
+        return false;
+    }
+    uint8_t next = EEPROM.read(logBase) % logSize;
+    EEPROM.get(slotAddress((next + logSize - 1 - index) % logSize), stall);
+    return stall.time != 0xFFFFFFFF;
+}
+} // namespace watchdog
@@ -0,0 +1,30 @@
+#pragma once
+#include <inttypes.h>
+
+// Loop stall detector on the watchdog timer. loop() checks in once per pass; a pass that
+// runs past settings.stallBudget makes the watchdog interrupt note the timer callback
+// that was running, the flash address it interrupted and the time. The pass may then
+// carry on, but if it has not checked in after resetAfter ms the watchdog resets the
+// board. The note is kept in .noinit RAM, which survives that reset, and is copied into
+// a log of the last few stalls in the EEPROM in the background.
+namespace watchdog
+{
+constexpr uint16_t resetAfter = 2000;
+constexpr uint8_t logSize = 3;
+
+struct Stall
+{
+    uint32_t time;   // millis() when the watchdog fired
+    uint16_t pc;     // byte address of the interrupted instruction, 0 in host builds
+    uint16_t length; // ms from the previous check-in to the next one
+    uint8_t timer;   // timers::Handle, timers::none outside of the timer callbacks
+    bool reset;      // the stall ended in a watchdog reset, length is unknown
+} __attribute__((packed));
+
+// Takes over a stall caught before a reset, after loadSettings()
+void begin();
+// Top of every loop pass
+void checkIn();
+// Entry `index` of the log, 0 is the latest. False when it is empty.
+bool entry(uint8_t index, Stall& stall);
+} // namespace watchdog
@@ -0,0 +1,327 @@
+#include "HidSink.h"
+#include "sim.h"
+
+#include <Hid.h>
+#include <Diag.h>
+
+#include <algorithm>
+
+namespace
+{
+constexpr size_t banks = 2;
+
+std::vector<hidsink::Report> sent;
+// Delivery times of the reports still sitting in the endpoint banks
+uint64_t pending[banks];
+size_t pendingCount = 0;
+uint32_t lastFrame = 0;
+uint8_t hostLeds = 0;
+hid::LedsCallback ledsCallback = nullptr;
+bool recording = true;
+bool muted = false;
+
+bool busSuspended = false;
+bool wakeupAllowed = false;
+uint64_t resumeAt = 0; // us, 0 while no wakeup is under way
+unsigned wakeupCount = 0;
+hid::SuspendCallback suspendCallback = nullptr;
+bool reportedSuspended = false;
+
+uint8_t keyboardReport[8] = {};
+uint16_t consumerKeys[4] = {};
+
+void popPending()
+{
+    std::copy(pending + 1, pending + pendingCount, pending);
+    --pendingCount;
+}
+
+void send(char device, const uint8_t* data, size_t length)
+{
+    if (muted) {
+        return;
+    }
+    diag::count(diag::HidReports);
+    while (pendingCount > 0 && pending[0] <= sim::now()) {
+        popPending();
+    }
+    if (pendingCount >= banks) {
+        sim::advance(pending[0] - sim::now());
+        popPending();
+    }
+
+    if (!recording) {
+        lastFrame = std::max<uint32_t>(sim::now() / hidsink::framePeriod + 1, lastFrame + 1);
+        pending[pendingCount++] = lastFrame * hidsink::framePeriod;
+        return;
+    }
+
+    hidsink::Report report;
+    report.queued = sim::now();
+    report.frame = std::max<uint32_t>(sim::now() / hidsink::framePeriod + 1, lastFrame + 1);
+    report.delivered = report.frame * hidsink::framePeriod;
+    report.device = device;
+    report.data.assign(data, data + length);
+    report.redundant = false;
+    for (auto it = sent.rbegin(); it != sent.rend(); ++it) {
+        if (it->device == device) {
+            report.redundant = it->data == report.data;
+            break;
+        }
+    }
+    lastFrame = report.frame;
+    pending[pendingCount++] = report.delivered;
+    sent.push_back(report);
+}
+
+void sendKeyboard()
+{
+    send('K', keyboardReport, sizeof(keyboardReport));
+}
+
+void sendConsumer()
+{
+    uint8_t data[sizeof(consumerKeys)];
+    for (size_t i = 0; i < 4; ++i) {
+        data[i * 2] = consumerKeys[i] & 0xFF;
+        data[i * 2 + 1] = consumerKeys[i] >> 8;
+    }
+    send('C', data, sizeof(data));
+}
+
+void sendScroll(int8_t wheel, int8_t pan)
+{
+    uint8_t data[] = {static_cast<uint8_t>(wheel), static_cast<uint8_t>(pan)};
+    send('M', data, sizeof(data));
+}
+
+bool isModifier(KeyboardKeycode key)
+{
+    return key >= KEY_LEFT_CTRL && key <= KEY_RIGHT_GUI;
+}
+
+// Only what the firmware types: letters, digits, space and newline
+KeyboardKeycode fromAscii(char c, bool& shift)
+{
+    shift = c >= 'A' && c <= 'Z';
+    if (c >= 'a' && c <= 'z') {
+        return KeyboardKeycode(KEY_A + c - 'a');
+    } else if (shift) {
+        return KeyboardKeycode(KEY_A + c - 'A');
+    } else if (c >= '1' && c <= '9') {
+        return KeyboardKeycode(KEY_1 + c - '1');
+    } else if (c == '0') {
+        return KEY_0;
+    } else if (c == ' ') {
+        return KEY_SPACE;
+    } else if (c == '\n') {
+        return KEY_ENTER;
+    }
+    return KEY_RESERVED;
+}
+} // namespace
+
+namespace hidsink
+{
+const std::vector<Report>& reports()
+{
+    return sent;
+}
+
+std::string format(const Report& report)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%llu.%03llu f%u %c",
+        static_cast<unsigned long long>(report.queued / 1000),
+        static_cast<unsigned long long>(report.queued % 1000), report.frame, report.device);
+    std::string line = buf;
+    for (auto byte : report.data) {
+        snprintf(buf, sizeof(buf), " %02x", byte);
+        line += buf;
+    }
+    if (report.redundant) {
+        line += " dup";
+    }
+    return line;
+}
+
+// The output report arrives, the firmware hears about it right away
+void setLeds(uint8_t leds)
+{
+    if (leds == hostLeds) {
+        return;
+    }
+    hostLeds = leds;
+    if (ledsCallback) {
+        ledsCallback(leds);
+    }
+}
+
+void setRecording(bool on)
+{
+    recording = on;
+}
+
+void suspend(bool allowWakeup)
+{
+    busSuspended = true;
+    wakeupAllowed = allowWakeup;
+    resumeAt = 0;
+}
+
+void resume()
+{
+    busSuspended = false;
+}
+
+unsigned wakeups()
+{
+    return wakeupCount;
+}
+} // namespace hidsink
+
+namespace hid
+{
+void begin()
+{
+}
+
+void press(KeyboardKeycode key)
+{
+    if (isModifier(key)) {
+        keyboardReport[0] |= 1 << (key - KEY_LEFT_CTRL);
+    } else if (std::find(keyboardReport + 2, keyboardReport + 8, key) == keyboardReport + 8) {
+        auto slot = std::find(keyboardReport + 2, keyboardReport + 8, 0);
+        if (slot != keyboardReport + 8) {
+            *slot = key;
+        }
+    }
+    sendKeyboard();
+}
+
+void release(KeyboardKeycode key)
+{
+    if (isModifier(key)) {
+        keyboardReport[0] &= ~(1 << (key - KEY_LEFT_CTRL));
+    } else {
+        std::replace(keyboardReport + 2, keyboardReport + 8, static_cast<uint8_t>(key), uint8_t(0));
+    }
+    sendKeyboard();
+}
+
+void write(KeyboardKeycode key)
+{
+    press(key);
+    release(key);
+}
+
+void scroll(int8_t wheel, int8_t pan)
+{
+    sendScroll(wheel, pan);
+}
+
+void print(const __FlashStringHelper* text)
+{
+    for (auto c = reinterpret_cast<const char*>(text); *c; ++c) {
+        bool shift = false;
+        KeyboardKeycode key = fromAscii(*c, shift);
+        if (key == KEY_RESERVED) {
+            continue;
+        }
+        if (shift) {
+            press(KEY_LEFT_SHIFT);
+        }
+        write(key);
+        if (shift) {
+            release(KEY_LEFT_SHIFT);
+        }
+    }
+}
+
+void send()
+{
+    sendKeyboard();
+}
+
+void mute(bool on)
+{
+    muted = on;
+}
+
+void onSuspend(SuspendCallback callback)
+{
+    suspendCallback = callback;
+}
+
+bool suspended()
+{
+    if (busSuspended && resumeAt != 0 && sim::now() >= resumeAt) {
+        busSuspended = false;
+    }
+    return busSuspended;
+}
+
+bool wakeup()
+{
+    if (!suspended() || !wakeupAllowed) {
+        return false;
+    }
+    if (resumeAt == 0) {
+        ++wakeupCount;
+        resumeAt = sim::now() + hidsink::resumeTime;
+    }
+    return true;
+}
+
+void press(ConsumerKeycode key)
+{
+    if (std::find(consumerKeys, consumerKeys + 4, key) != consumerKeys + 4) {
+        return;
+    }
+    auto slot = std::find(consumerKeys, consumerKeys + 4, 0);
+    if (slot != consumerKeys + 4) {
+        *slot = key;
+    }
+    sendConsumer();
+}
+
+void release(ConsumerKeycode key)
+{
+    std::replace(consumerKeys, consumerKeys + 4, static_cast<uint16_t>(key), uint16_t(0));
+    sendConsumer();
+}
+
+void write(ConsumerKeycode key)
+{
+    press(key);
+    release(key);
+}
+
+// The host sends no SOFs to a suspended bus
+uint8_t frame()
+{
+    static uint8_t last = 0;
+    if (!busSuspended) {
+        last = sim::now() / hidsink::framePeriod;
+    }
+    return last;
+}
+
+void onLeds(LedsCallback callback)
+{
+    ledsCallback = callback;
+}
+
+// The LED byte goes to the callback right away in setLeds(), the suspend state is
+// compared here like on the board
+void poll()
+{
+    bool now = suspended();
+    if (now != reportedSuspended) {
+        reportedSuspended = now;
+        if (suspendCallback) {
+            suspendCallback(now);
+        }
+    }
+}
+} // namespace hid
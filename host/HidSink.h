@@ -0,0 +1,36 @@
+#pragma once
+// Host backend of Hid.h. Reports are queued into a simulated interrupt IN endpoint with
+// two banks, like the 32u4 configures them, and the host polls it once per 1 ms frame.
+// A third report blocks the sender until a bank is free, as USB_Send() does.
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+namespace hidsink
+{
+constexpr uint64_t framePeriod = 1000; // us
+
+struct Report
+{
+    uint64_t queued;    // us, when the firmware handed it over
+    uint64_t delivered; // us, start of the frame in which the host polled it
+    uint32_t frame;
+    char device; // 'K' keyboard, 'C' consumer, 'M' wheel and pan
+    std::vector<uint8_t> data;
+    bool redundant; // same content as the previous report of this device
+};
+
+const std::vector<Report>& reports();
+std::string format(const Report& report);
+void setLeds(uint8_t leds);
+// The host suspends the bus. With `allowWakeup` it accepts remote wakeup and resumes
+// the bus resumeTime after the device signals it.
+void suspend(bool allowWakeup = true);
+constexpr uint64_t resumeTime = 30000; // us
+// The host resumes on its own
+void resume();
+// Remote wakeup signals seen so far
+unsigned wakeups();
+// Off: reports still occupy the endpoint banks but are not kept, for long benchmark runs
+void setRecording(bool on);
+} // namespace hidsink
@@ -0,0 +1,197 @@
+// Host microbenchmarks of the firmware's hot paths, run against the simulated board.
+// Output follows the Go benchmark format so two runs can be compared line by line or
+// with benchstat:
+//   Benchmark<Name> <iterations> <ns> ns/op <allocs> allocs/op
+// Times are host nanoseconds, they track the relative cost of the code, not the time
+// it takes on the 32u4. Allocations count every operator new inside the measured code.
+#include "sim.h"
+#include "HidSink.h"
+
+#include <Arduino.h>
+#include <HID-Project.h>
+#include <IRremote.h>
+
+#include "Input.h"
+#include "Keyboard.h"
+#include "Keymap.h"
+#include "LCD.h"
+#include "Out.h"
+#include "Settings.h"
+#include "Tick.h"
+#include "IR.h"
+#include "Volume.h"
+#include "Watchdog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <new>
+
+void setup();
+void loop();
+
+namespace
+{
+// Each benchmark runs for at least this long
+constexpr auto minDuration = std::chrono::milliseconds(200);
+
+bool counting = false;
+uint64_t allocations = 0;
+
+// Harness work inside an operation, such as queueing simulated input, is not counted
+struct Uncounted
+{
+    Uncounted() : saved(counting)
+    {
+        counting = false;
+    }
+    ~Uncounted()
+    {
+        counting = saved;
+    }
+    bool saved;
+};
+
+void run(const char* name, const std::function<void()>& op)
+{
+    using clock = std::chrono::steady_clock;
+    uint64_t iterations = 1;
+    while (true) {
+        allocations = 0;
+        counting = true;
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        auto elapsed = clock::now() - start;
+        counting = false;
+        if (elapsed >= minDuration || iterations >= (1ULL << 32)) {
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+            printf("Benchmark%s\t%llu\t%.1f ns/op\t%.2f allocs/op\n", name,
+                static_cast<unsigned long long>(iterations), ns / iterations,
+                static_cast<double>(allocations) / iterations);
+            fflush(stdout);
+            return;
+        }
+        iterations *= 2;
+    }
+}
+
+// Moves simulated time on without running the firmware's timers
+void skip(uint64_t us)
+{
+    sim::advance(us);
+    tick::update();
+}
+
+// The keymap as it was before the flat tables, for comparison
+std::map<int, KeyboardKeycode> mapKeymap = {{5, KEY_INSERT}, {6, KEY_HOME}, {7, KEY_PAGE_UP},
+    {8, KEY_LEFT_ALT}, {9, KEY_DELETE}, {10, KEY_END}, {11, KEY_PAGE_DOWN}, {12, KEY_LEFT_SHIFT},
+    {14, KEY_UP_ARROW}, {16, KEY_LEFT_CTRL}, {17, KEY_LEFT_ARROW}, {18, KEY_DOWN_ARROW},
+    {19, KEY_RIGHT_ARROW}};
+
+volatile int sink;
+} // namespace
+
+void* operator new(size_t size)
+{
+    if (counting) {
+        ++allocations;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+int main()
+{
+    setup();
+    // Let the LCD finish its power-on sequence
+    for (int i = 0; i < 200; ++i) {
+        loop();
+        sim::advance(1000);
+    }
+    out::Enabled = false;
+    settings.idleTimeout = 0;
+    // The benchmarks move time on without the loop checking in
+    settings.stallBudget = 0;
+    watchdog::checkIn();
+    hidsink::setRecording(false);
+
+    run("MatrixScanIdle", [] {
+        skip(1000);
+        readMatrix();
+    });
+
+    // A press or a release every pass, past the debounce window of the previous edge
+    int key = 5;
+    run("MatrixDispatch", [&] {
+        {
+            Uncounted uncounted;
+            sim::setKeys(sim::keys() ^ (1UL << key));
+            skip(10000);
+        }
+        readMatrix();
+    });
+    sim::setKeys(0);
+    skip(10000);
+    readMatrix();
+
+    int idx = 0;
+    run("KeymapFlat", [&] {
+        sink = keymap::lookup(0, idx);
+        idx = (idx + 1) % keyCount();
+    });
+    run("KeymapStdMap", [&] {
+        sink = mapKeymap.count(idx) > 0 ? mapKeymap[idx] : KEY_RESERVED;
+        idx = (idx + 1) % keyCount();
+    });
+
+    // A key action from press to release, both HID reports included
+    run("ExecuteKey", [] {
+        uint16_t act = action::make(action::Key, KEY_INSERT);
+        input::execute({input::Matrix, 5, input::Press, tick::now()}, act);
+        input::execute({input::Matrix, 5, input::Release, tick::now()}, act);
+    });
+
+    lcd.setPersistentStrings(F("A persistent string longer than the display"), F("Second row"));
+    lcd.setBounceType(LiquidCrystal::BounceType::Bounce);
+    run("MarqueeBounce", [] { lcd.marqueeStep(); });
+    lcd.setBounceType(LiquidCrystal::BounceType::Loop);
+    run("MarqueeLoop", [] { lcd.marqueeStep(); });
+
+    // One encoder detent up or down per pass, alternating so the volume stays in range.
+    // The step takes three calls: press, release and rest.
+    bool up = true;
+    run("VolumeStep", [&] {
+        addTargetVolume(up ? 0.02 : -0.02);
+        up = !up;
+        for (int i = 0; i < 3; ++i) {
+            checkVolume();
+        }
+    });
+
+    // A press followed by its first repeat, which is where the action fires. The frames
+    // arrive as edges while time passes, checkIR() runs at the loop's 10 ms period.
+    run("IrDecodeAction", [] {
+        {
+            Uncounted uncounted;
+            sim::pushIr(0, 0x40, 0);
+            sim::pushIr(0, 0x40, IRDATA_FLAGS_IS_REPEAT);
+        }
+        for (int i = 0; i < 10; ++i) {
+            skip(10000);
+            checkIR();
+        }
+    });
+    return 0;
+}
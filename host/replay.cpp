@@ -0,0 +1,316 @@
+// Feeds a trace recorded by the firmware (format in Trace.h) through setup() and loop()
+// in simulated time. Prints every HID report with the USB frame that carried it, then
+// timing metrics as '#' lines, so the output can be diffed against a golden file or
+// between firmware revisions. Latency runs from a matrix edge to the start of the
+// frame in which the host polled the report that reflects it: for a press the first
+// one after it that adds a key or usage, for a release the first one of the same
+// device that drops what the press added. A release the device already dropped, as
+// after a consumer tap, has no latency.
+// Arguments after the trace are console lines typed in before it starts, for example
+//   build/replay traces/typing.trace "set sync 1"
+#include "sim.h"
+#include "HidSink.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+void setup();
+void loop();
+
+namespace
+{
+struct Event
+{
+    uint64_t time; // us, relative to the first event
+    char kind;
+    uint32_t keys;
+    int delta;
+    uint16_t address;
+    uint16_t command;
+    uint8_t flags;
+};
+
+// Idle time after the last event so delayed reports still show up
+constexpr uint64_t tail = 1000000;
+// Cost of one loop() pass with nothing due, so simulated time always moves
+constexpr uint64_t loopOverhead = 10;
+
+bool parse(std::istream& in, std::vector<Event>& events)
+{
+    std::string line;
+    int lineNo = 0;
+    uint64_t first = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        unsigned long ms = 0;
+        Event event = {};
+        fields >> ms >> event.kind;
+        switch (event.kind) {
+            case 'M':
+                fields >> std::hex >> event.keys;
+                break;
+            case 'E':
+                fields >> event.delta;
+                break;
+            case 'I': {
+                unsigned address = 0, command = 0, flags = 0;
+                fields >> std::hex >> address >> command >> flags;
+                event.address = address;
+                event.command = command;
+                event.flags = flags;
+                break;
+            }
+            default:
+                fields.setstate(std::ios::failbit);
+                break;
+        }
+        if (!fields) {
+            std::cerr << "line " << lineNo << ": cannot parse '" << line << "'" << std::endl;
+            return false;
+        }
+        if (events.empty()) {
+            first = ms;
+        }
+        event.time = (ms - first) * 1000;
+        events.push_back(event);
+    }
+    return true;
+}
+
+void apply(const Event& event)
+{
+    switch (event.kind) {
+        case 'M':
+            sim::setKeys(event.keys);
+            break;
+        case 'E':
+            for (int i = 0; i < std::abs(event.delta); ++i) {
+                sim::encoderStep(event.delta);
+            }
+            break;
+        case 'I':
+            sim::pushIr(event.address, event.command, event.flags);
+            break;
+    }
+}
+
+struct Edge
+{
+    uint64_t time;
+    int key;
+    bool pressed;
+};
+
+// What a report holds: the modifier bits and key codes of the keyboard, the usages of
+// the consumer device. Wheel and pan reports are motion and hold nothing.
+std::set<int> contents(const hidsink::Report& report)
+{
+    std::set<int> held;
+    const auto& data = report.data;
+    if (report.device == 'K') {
+        for (int bit = 0; bit < 8; ++bit) {
+            if (data[0] >> bit & 1) {
+                held.insert(0xE0 + bit);
+            }
+        }
+        for (size_t i = 2; i < data.size(); ++i) {
+            if (data[i]) {
+                held.insert(data[i]);
+            }
+        }
+    } else if (report.device == 'C') {
+        for (size_t i = 0; i + 1 < data.size(); i += 2) {
+            if (int usage = data[i] | data[i + 1] << 8) {
+                held.insert(usage);
+            }
+        }
+    }
+    return held;
+}
+
+std::set<int> difference(const std::set<int>& a, const std::set<int>& b)
+{
+    std::set<int> result;
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+        std::inserter(result, result.end()));
+    return result;
+}
+
+bool overlaps(const std::set<int>& a, const std::set<int>& b)
+{
+    return std::any_of(a.begin(), a.end(), [&](int x) { return b.count(x) > 0; });
+}
+
+uint64_t percentile(std::vector<uint64_t> values, int pct)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * pct / 100];
+}
+
+void printDistribution(const char* name, const std::vector<uint64_t>& values)
+{
+    std::cout << "# " << name << " n " << values.size() << " p50 " << percentile(values, 50)
+              << " p90 " << percentile(values, 90) << " max " << percentile(values, 100) << "\n";
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <trace> [console line...]" << std::endl;
+        return 2;
+    }
+    std::ifstream file(argv[1]);
+    std::vector<Event> events;
+    if (!file || !parse(file, events)) {
+        std::cerr << "cannot read trace " << argv[1] << std::endl;
+        return 1;
+    }
+
+    setup();
+    for (int i = 2; i < argc; ++i) {
+        sim::serialInput(std::string(argv[i]) + "\n");
+    }
+    const uint64_t start = sim::now();
+    const uint64_t end = start + (events.empty() ? 0 : events.back().time) + tail;
+
+    // Matrix edges, to match against the reports that reflect them
+    std::vector<Edge> edges;
+    uint32_t keys = 0;
+    size_t next = 0;
+    uint64_t passes = 0;
+    uint64_t worstPass = 0;
+    while (sim::now() < end) {
+        while (next < events.size() && start + events[next].time <= sim::now()) {
+            const auto& event = events[next++];
+            if (event.kind == 'M') {
+                for (uint32_t changed = keys ^ event.keys; changed; changed &= changed - 1) {
+                    int key = __builtin_ctzl(changed);
+                    edges.push_back({sim::now(), key, (event.keys >> key & 1) != 0});
+                }
+                keys = event.keys;
+            }
+            apply(event);
+        }
+        uint64_t before = sim::now();
+        loop();
+        ++passes;
+        uint64_t spent = sim::now() - before;
+        if (spent == 0) {
+            sim::advance(loopOverhead);
+            spent = loopOverhead;
+        }
+        worstPass = std::max(worstPass, spent);
+    }
+
+    const auto& reports = hidsink::reports();
+    size_t redundant = 0;
+    for (const auto& report : reports) {
+        std::cout << hidsink::format(report) << "\n";
+        redundant += report.redundant;
+    }
+
+    // What each report added to and dropped from the previous one of its device
+    std::vector<std::set<int>> added(reports.size());
+    std::vector<std::set<int>> dropped(reports.size());
+    std::map<char, std::set<int>> held;
+    for (size_t i = 0; i < reports.size(); ++i) {
+        auto now = contents(reports[i]);
+        auto& before = held[reports[i].device];
+        added[i] = difference(now, before);
+        dropped[i] = difference(before, now);
+        before = now;
+    }
+
+    // The report that reflects a press, and what it added, per held key
+    struct Press
+    {
+        size_t report;
+        std::set<int> usages;
+    };
+    std::map<int, Press> down;
+    std::vector<uint64_t> latencies;
+    std::map<int, std::vector<uint64_t>> keyLatencies;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const auto& edge = edges[i];
+        size_t r = reports.size();
+        if (edge.pressed && down.count(edge.key)) {
+            // Back down after a bounce the debouncer ate, the reports never saw it go
+            r = reports.size();
+        } else if (edge.pressed) {
+            uint64_t limit = i + 1 < edges.size() ? edges[i + 1].time : end;
+            r = std::lower_bound(reports.begin(), reports.end(), edge.time,
+                    [](const hidsink::Report& report, uint64_t time) {
+                        return report.queued < time;
+                    }) -
+                reports.begin();
+            while (r < reports.size() && reports[r].queued < limit && added[r].empty()) {
+                ++r;
+            }
+            if (r < reports.size() && reports[r].queued < limit) {
+                down[edge.key] = {r, added[r]};
+            } else {
+                r = reports.size();
+            }
+        } else if (down.count(edge.key)) {
+            const Press& press = down[edge.key];
+            char device = reports[press.report].device;
+            for (r = press.report + 1; r < reports.size(); ++r) {
+                if (reports[r].device == device && overlaps(dropped[r], press.usages)) {
+                    break;
+                }
+            }
+            uint64_t again = end;
+            for (size_t j = i + 1; j < edges.size(); ++j) {
+                if (edges[j].key == edge.key) {
+                    again = edges[j].time;
+                    break;
+                }
+            }
+            if (r < reports.size() && reports[r].queued >= again) {
+                // A bounce, the key is still held when the drop comes
+                r = reports.size();
+            } else {
+                down.erase(edge.key);
+                // Dropped before the key was let go
+                if (r < reports.size() && reports[r].queued < edge.time) {
+                    r = reports.size();
+                }
+            }
+        }
+        if (r < reports.size()) {
+            uint64_t latency = reports[r].delivered - edge.time;
+            latencies.push_back(latency);
+            keyLatencies[edge.key].push_back(latency);
+        }
+    }
+
+    uint64_t total = sim::now() - start;
+    std::cout << "# setup_us " << start << "\n";
+    std::cout << "# events " << events.size() << "\n";
+    std::cout << "# reports " << reports.size() << " redundant " << redundant << "\n";
+    std::cout << "# sim_us " << total << "\n";
+    std::cout << "# loop_passes " << passes << "\n";
+    std::cout << "# worst_pass_us " << worstPass << "\n";
+    std::cout << "# sleep_pct " << (total ? 100 * sim::sleepTime() / total : 0) << "\n";
+    std::cout << "# edges " << edges.size() << " reported " << latencies.size() << "\n";
+    printDistribution("latency_us", latencies);
+    for (const auto& key : keyLatencies) {
+        std::string name = "key " + std::to_string(key.first) + " latency_us";
+        printDistribution(name.c_str(), key.second);
+    }
+    return 0;
+}
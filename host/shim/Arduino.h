@@ -0,0 +1,99 @@
+#pragma once
+// Host stand-in for the parts of the Arduino AVR core the firmware uses. Pins, time and
+// USB are simulated by host/sim.cpp.
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Print.h"
+
+typedef uint8_t byte;
+
+#define F_CPU 16000000UL
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define snprintf_P snprintf
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+#define digitalPinToInterrupt(p) (p)
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode);
+
+// Every pin is its own port with a single bit. Register accesses go through the pin model
+// so that a row switched to output is seen by the column reads right away.
+class PortRegister
+{
+public:
+    enum Kind : uint8_t { Mode, Output, Input };
+    PortRegister(Kind kind, uint8_t port) : kind_(kind), port_(port)
+    {
+    }
+    operator uint8_t() const;
+    PortRegister& operator=(uint8_t value);
+    PortRegister& operator|=(uint8_t value)
+    {
+        return *this = *this | value;
+    }
+    PortRegister& operator&=(uint8_t value)
+    {
+        return *this = *this & value;
+    }
+
+private:
+    Kind kind_;
+    uint8_t port_;
+};
+PortRegister* portModeRegister(uint8_t port);
+PortRegister* portOutputRegister(uint8_t port);
+PortRegister* portInputRegister(uint8_t port);
+#define digitalPinToPort(p) (p)
+#define digitalPinToBitMask(p) (1)
+
+class Serial_ : public Print
+{
+public:
+    void begin(unsigned long)
+    {
+    }
+    operator bool()
+    {
+        return true;
+    }
+    int available();
+    int read();
+    int availableForWrite();
+    size_t write(uint8_t c) override;
+    using Print::write;
+};
+extern Serial_ Serial;
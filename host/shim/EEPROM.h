@@ -0,0 +1,42 @@
+#pragma once
+// Host stand-in for the Arduino EEPROM library, the cells live in host/sim.cpp
+#include <inttypes.h>
+#include <string.h>
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int idx);
+    void write(int idx, uint8_t value);
+    void update(int idx, uint8_t value)
+    {
+        if (read(idx) != value) {
+            write(idx, value);
+        }
+    }
+    uint16_t length()
+    {
+        return 1024;
+    }
+
+    template <typename T>
+    T& get(int idx, T& value)
+    {
+        auto bytes = reinterpret_cast<uint8_t*>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = read(idx + i);
+        }
+        return value;
+    }
+
+    template <typename T>
+    const T& put(int idx, const T& value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            update(idx + i, bytes[i]);
+        }
+        return value;
+    }
+};
+extern EEPROMClass EEPROM;
@@ -0,0 +1,4 @@
+#pragma once
+#include "MultiReport/Consumer.h"
+#include "MultiReport/ImprovedKeyboard.h"
+#include "SingleReport/BootKeyboard.h"
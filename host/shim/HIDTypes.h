@@ -0,0 +1,63 @@
+#pragma once
+// Keycodes of HID-Project for the host builds. The devices themselves are not needed,
+// the firmware reaches them through Hid.h and the host links HidSink.cpp for that.
+#include <Arduino.h>
+
+enum KeyboardKeycode : uint8_t {
+    KEY_RESERVED = 0x00,
+    KEY_A = 0x04,
+    KEY_Z = 0x1D,
+    KEY_1 = 0x1E,
+    KEY_0 = 0x27,
+    KEY_ENTER = 0x28,
+    KEY_ESC = 0x29,
+    KEY_BACKSPACE = 0x2A,
+    KEY_TAB = 0x2B,
+    KEY_SPACE = 0x2C,
+    KEY_MINUS = 0x2D,
+    KEY_PERIOD = 0x37,
+    KEY_SLASH = 0x38,
+    KEY_CAPS_LOCK = 0x39,
+    KEY_F1 = 0x3A,
+    KEY_F12 = 0x45,
+    KEY_PRINTSCREEN = 0x46,
+    KEY_SCROLL_LOCK = 0x47,
+    KEY_PAUSE = 0x48,
+    KEY_INSERT = 0x49,
+    KEY_HOME = 0x4A,
+    KEY_PAGE_UP = 0x4B,
+    KEY_DELETE = 0x4C,
+    KEY_END = 0x4D,
+    KEY_PAGE_DOWN = 0x4E,
+    KEY_RIGHT_ARROW = 0x4F,
+    KEY_LEFT_ARROW = 0x50,
+    KEY_DOWN_ARROW = 0x51,
+    KEY_UP_ARROW = 0x52,
+    KEY_NUM_LOCK = 0x53,
+    KEY_F24 = 0x73,
+    KEY_LEFT_CTRL = 0xE0,
+    KEY_LEFT_SHIFT = 0xE1,
+    KEY_LEFT_ALT = 0xE2,
+    KEY_LEFT_GUI = 0xE3,
+    KEY_RIGHT_CTRL = 0xE4,
+    KEY_RIGHT_SHIFT = 0xE5,
+    KEY_RIGHT_ALT = 0xE6,
+    KEY_RIGHT_GUI = 0xE7,
+};
+
+enum ConsumerKeycode : uint16_t {
+    MEDIA_NEXT = 0xB5,
+    MEDIA_PREVIOUS = 0xB6,
+    MEDIA_STOP = 0xB7,
+    MEDIA_PLAY_PAUSE = 0xCD,
+    MEDIA_VOLUME_MUTE = 0xE2,
+    MEDIA_VOL_MUTE = MEDIA_VOLUME_MUTE,
+    MEDIA_VOLUME_UP = 0xE9,
+    MEDIA_VOL_UP = MEDIA_VOLUME_UP,
+    MEDIA_VOLUME_DOWN = 0xEA,
+    MEDIA_VOL_DOWN = MEDIA_VOLUME_DOWN,
+};
+
+#define LED_NUM_LOCK 0x01
+#define LED_CAPS_LOCK 0x02
+#define LED_SCROLL_LOCK 0x04
@@ -0,0 +1,31 @@
+#pragma once
+// Host stand-in for IRremote, frames are queued by the replay driver
+#include <Arduino.h>
+
+#define ENABLE_LED_FEEDBACK true
+#define IRDATA_FLAGS_IS_REPEAT 0x01
+
+enum decode_type_t { UNKNOWN = 0, NEC = 8 };
+
+struct IRData
+{
+    decode_type_t protocol = UNKNOWN;
+    uint16_t address = 0;
+    uint16_t command = 0;
+    uint8_t flags = 0;
+};
+
+struct decode_results
+{
+};
+
+class IRrecv
+{
+public:
+    void begin(uint8_t pin, bool ledFeedback = false);
+    bool decode();
+    void resume();
+
+    IRData decodedIRData;
+};
+extern IRrecv IrReceiver;
@@ -0,0 +1,82 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEC 10
+#define HEX 16
+
+class __FlashStringHelper;
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t) = 0;
+    size_t write(const char* str)
+    {
+        return str ? write(reinterpret_cast<const uint8_t*>(str), strlen(str)) : 0;
+    }
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--) {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+
+    size_t print(const __FlashStringHelper* s)
+    {
+        return write(reinterpret_cast<const char*>(s));
+    }
+    size_t print(const char* s)
+    {
+        return write(s);
+    }
+    size_t print(char c)
+    {
+        return write(static_cast<uint8_t>(c));
+    }
+    size_t print(unsigned char n, int base = DEC)
+    {
+        return print(static_cast<unsigned long>(n), base);
+    }
+    size_t print(int n, int base = DEC)
+    {
+        return print(static_cast<long>(n), base);
+    }
+    size_t print(unsigned int n, int base = DEC)
+    {
+        return print(static_cast<unsigned long>(n), base);
+    }
+    size_t print(long n, int base = DEC)
+    {
+        if (base == DEC && n < 0) {
+            return write('-') + print(static_cast<unsigned long>(-n), base);
+        }
+        return print(static_cast<unsigned long>(n), base);
+    }
+    size_t print(unsigned long n, int base = DEC)
+    {
+        char buf[24];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+        return write(buf);
+    }
+    size_t print(double n, int digits = 2)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", digits, n);
+        return write(buf);
+    }
+    size_t println()
+    {
+        return write("\r\n");
+    }
+    template <typename T>
+    size_t println(const T& t)
+    {
+        return print(t) + println();
+    }
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+// False while the simulated EEPROM is busy with a write cycle
+bool eeprom_is_ready();
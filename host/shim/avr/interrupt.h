@@ -0,0 +1,3 @@
+#pragma once
+// Interrupt handlers are plain functions, host/sim.cpp calls them when their pin changes
+#define ISR(vector) extern "C" void vector()
@@ -0,0 +1,19 @@
+#pragma once
+// Host stand-in for the 32u4 registers the firmware sets directly, they live in
+// host/sim.cpp
+#include <inttypes.h>
+
+#define _BV(bit) (1 << (bit))
+
+extern uint8_t PCICR;
+extern uint8_t PCMSK0;
+extern uint8_t PCIFR;
+#define PCIE0 0
+#define PCIF0 0
+#define PCINT2 2
+
+extern uint8_t WDTCSR;
+#define WDP0 0
+#define WDE 3
+#define WDP3 5
+#define WDIE 6
@@ -0,0 +1,7 @@
+#pragma once
+
+#define SLEEP_MODE_IDLE 0
+
+void set_sleep_mode(int mode);
+// Returns at the next timer0 overflow, pin change interrupts run on the way
+void sleep_mode();
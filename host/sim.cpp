@@ -0,0 +1,473 @@
+#include "sim.h"
+
+#include <Arduino.h>
+#include <IRremote.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// The pin change front end of IrCapture.cpp, absent from IR_IRREMOTE builds
+extern "C" void PCINT0_vect() __attribute__((weak));
+extern "C" void WDT_vect() __attribute__((weak));
+
+namespace
+{
+// Wiring of the board, must match Keyboard.cpp: key index = row * numCols + col
+const uint8_t rowPins[] = {10, 6, 5, 15, 14};
+const uint8_t colPins[] = {21, 20, 19, 18};
+constexpr int numCols = sizeof(colPins);
+constexpr uint8_t encoderA = 1;
+constexpr uint8_t encoderB = 0;
+// PB2, PCINT2
+constexpr uint8_t irPin = 16;
+
+// Rough cost of the Arduino pin helpers at 16 MHz
+constexpr uint64_t pinCost = 4;
+constexpr uint64_t timer0Period = 1024;
+constexpr uint64_t eepromWriteTime = 3400;
+
+constexpr int numPins = 32;
+// DDR and PORT bit of every pin, levels[] holds what outside hardware drives
+uint8_t ddr[numPins] = {};
+uint8_t outputs[numPins] = {};
+uint8_t levels[numPins] = {};
+void (*isrs[numPins])() = {};
+std::vector<PortRegister> registers;
+uint8_t eeprom[1024];
+uint64_t eepromBusyUntil = 0;
+
+uint64_t clock = 0;
+uint64_t slept = 0;
+uint32_t matrix = 0;
+std::deque<IRData> irFrames;
+// Receiver output levels to come, each at its time in us
+std::deque<std::pair<uint64_t, uint8_t>> irEdges;
+// Last wdt_reset() or watchdog timeout
+uint64_t watchdogStart = 0;
+uint64_t watchdogResets = 0;
+// Time of the next IR edge or watchdog timeout, kept apart so that spend() stays a
+// compare and an add
+uint64_t nextEvent = UINT64_MAX;
+std::string serialOut;
+std::deque<char> serialIn;
+
+// A column reads low when a held key connects it to a row that is driven low
+uint8_t level(uint8_t pin)
+{
+    if (ddr[pin]) {
+        return outputs[pin];
+    }
+    for (int col = 0; col < numCols; ++col) {
+        if (colPins[col] != pin) {
+            continue;
+        }
+        for (size_t row = 0; row < sizeof(rowPins); ++row) {
+            uint8_t rowPin = rowPins[row];
+            if (ddr[rowPin] && outputs[rowPin] == LOW &&
+                (matrix & (1UL << (row * numCols + col)))) {
+                return LOW;
+            }
+        }
+        return HIGH;
+    }
+    return levels[pin];
+}
+
+void setLevel(uint8_t pin, uint8_t value)
+{
+    bool changed = levels[pin] != value;
+    levels[pin] = value;
+    if (changed && isrs[pin]) {
+        isrs[pin]();
+    }
+    if (changed && pin == irPin && (PCICR & _BV(PCIE0)) && (PCMSK0 & _BV(PCINT2)) &&
+        PCINT0_vect) {
+        PCINT0_vect();
+    }
+}
+
+// 16 ms << the WDP bits, while WDE or WDIE arms the watchdog
+uint64_t watchdogTimeout()
+{
+    if (!(WDTCSR & (_BV(WDE) | _BV(WDIE)))) {
+        return UINT64_MAX;
+    }
+    uint8_t prescaler = (WDTCSR & 7) | (WDTCSR & _BV(WDP3) ? 8 : 0);
+    return watchdogStart + (16000ULL << prescaler);
+}
+
+void scheduleNext()
+{
+    nextEvent = std::min(irEdges.empty() ? UINT64_MAX : irEdges.front().first, watchdogTimeout());
+}
+
+// Interrupt and reset mode: the interrupt clears WDIE, the timeout after that resets.
+// The simulated board cannot reset, it only counts them.
+void watchdogFires()
+{
+    watchdogStart = clock;
+    if (WDTCSR & _BV(WDIE)) {
+        WDTCSR &= ~_BV(WDIE);
+        if (WDT_vect) {
+            WDT_vect();
+        }
+    } else {
+        ++watchdogResets;
+    }
+}
+
+// Moves the clock to `target`, changing the IR receiver output on the way at the exact
+// time of each edge so the pin change interrupt timestamps it right, and running the
+// watchdog interrupt at its timeout
+void runUntil(uint64_t target)
+{
+    while (nextEvent <= target) {
+        clock = std::max(clock, nextEvent);
+        if (!irEdges.empty() && irEdges.front().first <= clock) {
+            auto edge = irEdges.front();
+            irEdges.pop_front();
+            setLevel(irPin, edge.second);
+        } else {
+            watchdogFires();
+        }
+        scheduleNext();
+    }
+    clock = std::max(clock, target);
+}
+
+void spend(uint64_t us)
+{
+    if (clock + us < nextEvent) {
+        clock += us;
+    } else {
+        runUntil(clock + us);
+    }
+}
+
+void irLevel(uint64_t& time, uint8_t level, uint64_t length)
+{
+    irEdges.emplace_back(time, level);
+    scheduleNext();
+    time += length;
+}
+
+// NEC as in sim/driver.c: 9 ms mark, 4.5 ms space, 32 bits of 562 us mark and 562 or
+// 1687 us space, stop mark. A repeat is 9 ms mark, 2.25 ms space and the stop mark.
+// The receiver output is low during a mark. Frames queue up behind each other.
+void scheduleNec(uint16_t address, uint16_t command, bool repeat)
+{
+    uint64_t time = irEdges.empty() ? clock : std::max(clock, irEdges.back().first + 1000);
+    irLevel(time, LOW, 9000);
+    if (repeat) {
+        irLevel(time, HIGH, 2250);
+    } else {
+        irLevel(time, HIGH, 4500);
+        uint16_t addressBits = address > 0xFF ? address : (~address & 0xFF) << 8 | address;
+        uint32_t frame = addressBits | static_cast<uint32_t>(command & 0xFF) << 16 |
+                         static_cast<uint32_t>(~command & 0xFF) << 24;
+        for (int i = 0; i < 32; ++i) {
+            irLevel(time, LOW, 562);
+            irLevel(time, HIGH, (frame >> i) & 1 ? 1687 : 562);
+        }
+    }
+    irLevel(time, LOW, 562);
+    irLevel(time, HIGH, 0);
+}
+} // namespace
+
+uint8_t PCICR = 0;
+uint8_t PCMSK0 = 0;
+uint8_t PCIFR = 0;
+uint8_t WDTCSR = 0;
+Serial_ Serial;
+EEPROMClass EEPROM;
+IRrecv IrReceiver;
+
+namespace sim
+{
+uint64_t now()
+{
+    return clock;
+}
+
+void advance(uint64_t us)
+{
+    spend(us);
+}
+
+uint64_t watchdogResets()
+{
+    return ::watchdogResets;
+}
+
+uint64_t sleepTime()
+{
+    return slept;
+}
+
+void setKeys(uint32_t keys)
+{
+    matrix = keys;
+}
+
+uint32_t keys()
+{
+    return matrix;
+}
+
+// One detent: B sets the direction, then A rises and falls
+void encoderStep(int dir)
+{
+    setLevel(encoderB, dir > 0 ? HIGH : LOW);
+    setLevel(encoderA, HIGH);
+    setLevel(encoderA, LOW);
+    setLevel(encoderB, LOW);
+}
+
+void pushIr(uint16_t address, uint16_t command, uint8_t flags)
+{
+    if (PCINT0_vect) {
+        scheduleNec(address, command, flags & IRDATA_FLAGS_IS_REPEAT);
+        return;
+    }
+    IRData data;
+    data.protocol = NEC;
+    data.address = address;
+    data.command = command;
+    data.flags = flags;
+    irFrames.push_back(data);
+}
+
+const std::string& serialOutput()
+{
+    return serialOut;
+}
+
+void serialInput(const std::string& data)
+{
+    serialIn.insert(serialIn.end(), data.begin(), data.end());
+}
+} // namespace sim
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    spend(pinCost);
+    ddr[pin] = mode == OUTPUT;
+    if (mode != OUTPUT) {
+        outputs[pin] = mode == INPUT_PULLUP;
+    }
+    if (mode == INPUT_PULLUP) {
+        levels[pin] = HIGH;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    spend(pinCost);
+    outputs[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    spend(pinCost);
+    return level(pin);
+}
+
+// Eight bits of three pin writes each, charged in one go
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t, uint8_t)
+{
+    spend(8 * 3 * pinCost);
+    outputs[dataPin] = LOW;
+    outputs[clockPin] = LOW;
+}
+
+unsigned long millis()
+{
+    return clock / 1000;
+}
+
+unsigned long micros()
+{
+    return clock;
+}
+
+void delay(unsigned long ms)
+{
+    spend(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    spend(us);
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int)
+{
+    isrs[interrupt] = isr;
+}
+
+PortRegister* portRegister(PortRegister::Kind kind, uint8_t port)
+{
+    if (registers.empty()) {
+        for (int i = 0; i < 3 * numPins; ++i) {
+            registers.emplace_back(PortRegister::Kind(i / numPins), i % numPins);
+        }
+    }
+    return &registers[kind * numPins + port];
+}
+
+PortRegister* portModeRegister(uint8_t port)
+{
+    return portRegister(PortRegister::Mode, port);
+}
+
+PortRegister* portOutputRegister(uint8_t port)
+{
+    return portRegister(PortRegister::Output, port);
+}
+
+PortRegister* portInputRegister(uint8_t port)
+{
+    return portRegister(PortRegister::Input, port);
+}
+
+// A direct register access is a single instruction on the AVR, the pin model charges
+// nothing for it
+PortRegister::operator uint8_t() const
+{
+    switch (kind_) {
+        case Mode:
+            return ddr[port_];
+        case Output:
+            return outputs[port_];
+        default:
+            return level(port_);
+    }
+}
+
+PortRegister& PortRegister::operator=(uint8_t value)
+{
+    if (kind_ == Mode) {
+        ddr[port_] = value & 1;
+    } else if (kind_ == Output) {
+        outputs[port_] = value & 1;
+    }
+    return *this;
+}
+
+// Erased cells read 0xFF, a write blocks until the previous write cycle is over
+uint8_t EEPROMClass::read(int idx)
+{
+    static bool erased = false;
+    if (!erased) {
+        memset(eeprom, 0xFF, sizeof(eeprom));
+        erased = true;
+    }
+    return eeprom[idx];
+}
+
+void EEPROMClass::write(int idx, uint8_t value)
+{
+    read(idx);
+    if (clock < eepromBusyUntil) {
+        runUntil(eepromBusyUntil);
+    }
+    eeprom[idx] = value;
+    eepromBusyUntil = clock + eepromWriteTime;
+}
+
+bool eeprom_is_ready()
+{
+    return clock >= eepromBusyUntil;
+}
+
+void set_sleep_mode(int)
+{
+}
+
+void wdt_enable(uint8_t value)
+{
+    WDTCSR = _BV(WDE) | (value & 8 ? _BV(WDP3) : 0) | (value & 7);
+    wdt_reset();
+}
+
+void wdt_disable()
+{
+    WDTCSR = 0;
+    scheduleNext();
+}
+
+void wdt_reset()
+{
+    watchdogStart = clock;
+    scheduleNext();
+}
+
+void sleep_mode()
+{
+    uint64_t wake = (clock / timer0Period + 1) * timer0Period;
+    slept += wake - clock;
+    runUntil(wake);
+}
+
+int Serial_::available()
+{
+    return serialIn.size();
+}
+
+int Serial_::read()
+{
+    if (serialIn.empty()) {
+        return -1;
+    }
+    char c = serialIn.front();
+    serialIn.pop_front();
+    return static_cast<uint8_t>(c);
+}
+
+int Serial_::availableForWrite()
+{
+    return 64;
+}
+
+size_t Serial_::write(uint8_t c)
+{
+    serialOut += static_cast<char>(c);
+    return 1;
+}
+
+void IRrecv::begin(uint8_t, bool)
+{
+}
+
+bool IRrecv::decode()
+{
+    if (irFrames.empty()) {
+        return false;
+    }
+    decodedIRData = irFrames.front();
+    return true;
+}
+
+void IRrecv::resume()
+{
+    if (!irFrames.empty()) {
+        irFrames.pop_front();
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+// Simulated board for the host builds: time, matrix wiring, encoder and IR.
+// Time only moves when the firmware spends it, each pin access costs roughly what
+// it does on the 16 MHz 32u4.
+#include <inttypes.h>
+#include <stddef.h>
+#include <string>
+
+namespace sim
+{
+uint64_t now();
+void advance(uint64_t us);
+// Time spent in sleep_mode()
+uint64_t sleepTime();
+// Watchdog timeouts that would have reset the board
+uint64_t watchdogResets();
+
+// Bit N set while key N of the matrix is held
+void setKeys(uint32_t keys);
+uint32_t keys();
+void encoderStep(int dir);
+// An NEC frame: the waveform on the receiver pin, or a decoded frame for IRremote
+// (IR_IRREMOTE builds)
+void pushIr(uint16_t address, uint16_t command, uint8_t flags);
+
+// Serial output of the firmware, and bytes the host types into it
+const std::string& serialOutput();
+void serialInput(const std::string& data);
+} // namespace sim
@@ -0,0 +1,378 @@
+// Runs the firmware ELF on simavr's ATmega32u4 and reports exact cycle counts of the
+// sections marked with PROFILE_MARK (Profile.h). Stimulus comes from a trace file in
+// the format of Trace.h:
+//   M <keys>  drives the key matrix, the column pins follow the rows after every instruction
+//   E <n>     n encoder detents, one edge per 250 us on pins 1 (PD3, INT3) and 0 (PD2)
+//   I <addr> <cmd> <flags>  an NEC frame on the IR receiver, pin 16 (PB2), active low
+// With a budget file ("<section> <max cycles>" per line) the exit status is 1 when any
+// section's worst case exceeds its budget. None is committed until the counts have been
+// measured on a real run.
+//
+//   driver firmware.elf trace [budgets]
+
+#include "avr_ioport.h"
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FREQUENCY 16000000UL
+#define CYCLES_PER_US (FREQUENCY / 1000000UL)
+#define MAX_STIMULI 4096
+// Keep running after the last event so deferred work shows up in the counts
+#define TAIL_US 1000000UL
+
+// Data space addresses of the port registers on the 32u4
+#define DDRB 0x24
+#define PORTB 0x25
+#define DDRC 0x27
+#define PORTC 0x28
+#define DDRD 0x2A
+#define PORTD 0x2B
+#define GPIOR0 0x3E
+
+// Board wiring, must match Keyboard.cpp: key = row * 4 + column
+struct pin
+{
+    uint8_t ddr;
+    uint8_t port;
+    uint8_t bit;
+};
+static const struct pin rows[] = {
+    {DDRB, PORTB, 6}, // D10
+    {DDRD, PORTD, 7}, // D6
+    {DDRC, PORTC, 6}, // D5
+    {DDRB, PORTB, 1}, // D15
+    {DDRB, PORTB, 3}, // D14
+};
+static const uint8_t columnBits[] = {4, 5, 6, 7}; // D21..D18 on PORTF
+#define NUM_ROWS (sizeof(rows) / sizeof(rows[0]))
+#define NUM_COLS (sizeof(columnBits) / sizeof(columnBits[0]))
+
+enum { SCAN, ISR, LOOP, IR_ISR, NUM_SECTIONS };
+static const char* sectionNames[NUM_SECTIONS] = {"scan", "isr", "loop", "irisr"};
+
+struct section
+{
+    avr_cycle_count_t start;
+    int open;
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+static struct section sections[NUM_SECTIONS];
+
+enum kind { KEYS, PIN };
+struct stimulus
+{
+    avr_cycle_count_t cycle;
+    enum kind kind;
+    uint32_t value; // KEYS: key bitmap, PIN: level
+    char port;
+    uint8_t bit;
+};
+static struct stimulus stimuli[MAX_STIMULI];
+static int numStimuli = 0;
+
+static avr_t* avr;
+static uint32_t keys = 0;
+// Column levels last raised on the PORTF pins, bit N for column N
+static uint8_t columnLevels = 0;
+
+static void addStimulus(avr_cycle_count_t cycle, enum kind kind, uint32_t value, char port,
+    uint8_t bit)
+{
+    if (numStimuli == MAX_STIMULI) {
+        fprintf(stderr, "too many stimuli\n");
+        exit(2);
+    }
+    struct stimulus* s = &stimuli[numStimuli++];
+    s->cycle = cycle;
+    s->kind = kind;
+    s->value = value;
+    s->port = port;
+    s->bit = bit;
+}
+
+static void addPin(avr_cycle_count_t cycle, char port, uint8_t bit, int level)
+{
+    addStimulus(cycle, PIN, level, port, bit);
+}
+
+// NEC: 9 ms mark, 4.5 ms space, 32 bits of 562 us mark and 562 or 1687 us space, stop
+// mark. A repeat is 9 ms mark, 2.25 ms space and the stop mark. The receiver output is
+// low during a mark.
+static void addNec(avr_cycle_count_t cycle, uint8_t address, uint8_t command, int repeat)
+{
+    avr_cycle_count_t t = cycle;
+    addPin(t, 'B', 2, 0);
+    t += 9000 * CYCLES_PER_US;
+    addPin(t, 'B', 2, 1);
+    if (repeat) {
+        t += 2250 * CYCLES_PER_US;
+    } else {
+        t += 4500 * CYCLES_PER_US;
+        uint32_t frame = address | (uint32_t)(uint8_t)~address << 8 | (uint32_t)command << 16 |
+                         (uint32_t)(uint8_t)~command << 24;
+        for (int i = 0; i < 32; ++i) {
+            addPin(t, 'B', 2, 0);
+            t += 562 * CYCLES_PER_US;
+            addPin(t, 'B', 2, 1);
+            t += ((frame >> i) & 1 ? 1687 : 562) * CYCLES_PER_US;
+        }
+    }
+    addPin(t, 'B', 2, 0);
+    t += 562 * CYCLES_PER_US;
+    addPin(t, 'B', 2, 1);
+}
+
+// One detent: B sets the direction, then A rises and falls
+static void addDetent(avr_cycle_count_t cycle, int dir)
+{
+    avr_cycle_count_t step = 250 * CYCLES_PER_US;
+    addPin(cycle, 'D', 2, dir > 0);
+    addPin(cycle + step, 'D', 3, 1);
+    addPin(cycle + 2 * step, 'D', 3, 0);
+    addPin(cycle + 3 * step, 'D', 2, 0);
+}
+
+static int compareStimuli(const void* a, const void* b)
+{
+    const struct stimulus* x = a;
+    const struct stimulus* y = b;
+    return x->cycle < y->cycle ? -1 : x->cycle > y->cycle;
+}
+
+static int loadTrace(const char* path, avr_cycle_count_t offset)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    char line[128];
+    int lineNo = 0;
+    long first = -1;
+    while (fgets(line, sizeof(line), f)) {
+        ++lineNo;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        unsigned long ms;
+        char kind;
+        int used = 0;
+        if (sscanf(line, "%lu %c %n", &ms, &kind, &used) < 2) {
+            fprintf(stderr, "%s:%d: cannot parse\n", path, lineNo);
+            fclose(f);
+            return 0;
+        }
+        if (first < 0) {
+            first = ms;
+        }
+        avr_cycle_count_t cycle = offset + (ms - first) * 1000 * CYCLES_PER_US;
+        const char* rest = line + used;
+        unsigned long a = 0, b = 0, c = 0;
+        int detents = 0;
+        switch (kind) {
+            case 'M':
+                sscanf(rest, "%lx", &a);
+                addStimulus(cycle, KEYS, a, 0, 0);
+                break;
+            case 'E':
+                sscanf(rest, "%d", &detents);
+                for (int i = 0; i < abs(detents); ++i) {
+                    addDetent(cycle + i * 1000 * CYCLES_PER_US, detents > 0 ? 1 : -1);
+                }
+                break;
+            case 'I':
+                sscanf(rest, "%lx %lx %lx", &a, &b, &c);
+                addNec(cycle, a, b, c & 1);
+                break;
+            default:
+                fprintf(stderr, "%s:%d: unknown event '%c'\n", path, lineNo, kind);
+                fclose(f);
+                return 0;
+        }
+    }
+    fclose(f);
+    qsort(stimuli, numStimuli, sizeof(stimuli[0]), compareStimuli);
+    return 1;
+}
+
+// A column is low when a held key connects it to a row that is driven low, high through
+// its pull-up otherwise. The ioport owns PINF, so the levels go in through its pin IRQs
+// rather than a read handler of our own, which simavr refuses to register.
+static void updateColumns(void)
+{
+    uint8_t levels = (1 << NUM_COLS) - 1;
+    for (unsigned row = 0; row < NUM_ROWS; ++row) {
+        const struct pin* r = &rows[row];
+        int driven = (avr->data[r->ddr] >> r->bit) & 1;
+        int high = (avr->data[r->port] >> r->bit) & 1;
+        if (!driven || high) {
+            continue;
+        }
+        for (unsigned col = 0; col < NUM_COLS; ++col) {
+            if ((keys >> (row * NUM_COLS + col)) & 1) {
+                levels &= ~(1 << col);
+            }
+        }
+    }
+    uint8_t changed = levels ^ columnLevels;
+    columnLevels = levels;
+    for (unsigned col = 0; col < NUM_COLS; ++col) {
+        if ((changed >> col) & 1) {
+            avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), columnBits[col]),
+                (levels >> col) & 1);
+        }
+    }
+}
+
+static void onMarker(struct avr_t* avr, avr_io_addr_t addr, uint8_t v, void* param)
+{
+    (void)param;
+    avr->data[addr] = v;
+    if (v == 0 || v > 2 * NUM_SECTIONS) {
+        return;
+    }
+    struct section* s = &sections[(v - 1) / 2];
+    if (v & 1) {
+        s->start = avr->cycle;
+        s->open = 1;
+        return;
+    }
+    if (!s->open) {
+        return;
+    }
+    s->open = 0;
+    uint64_t cycles = avr->cycle - s->start;
+    if (s->count == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->total += cycles;
+    ++s->count;
+}
+
+static int checkBudgets(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    int ok = 1;
+    char name[32];
+    unsigned long long budget;
+    while (fscanf(f, "%31s %llu", name, &budget) == 2) {
+        if (name[0] == '#') {
+            fscanf(f, "%*[^\n]");
+            continue;
+        }
+        int found = 0;
+        for (int i = 0; i < NUM_SECTIONS; ++i) {
+            if (strcmp(name, sectionNames[i]) != 0) {
+                continue;
+            }
+            found = 1;
+            if (sections[i].count == 0) {
+                printf("FAIL %s never ran\n", name);
+                ok = 0;
+            } else if (sections[i].max > budget) {
+                printf("FAIL %s max %llu > budget %llu cycles\n", name,
+                    (unsigned long long)sections[i].max, budget);
+                ok = 0;
+            }
+        }
+        if (!found) {
+            printf("FAIL unknown section %s in %s\n", name, path);
+            ok = 0;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s firmware.elf trace [budgets]\n", argv[0]);
+        return 2;
+    }
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "%s: cannot load\n", argv[1]);
+        return 2;
+    }
+    avr = avr_make_mcu_by_name("atmega32u4");
+    if (!avr) {
+        fprintf(stderr, "simavr has no atmega32u4 core\n");
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = FREQUENCY;
+    avr->log = LOG_WARNING;
+
+    // No peripheral of the 32u4 core claims GPIOR0
+    avr_register_io_write(avr, GPIOR0, onMarker, NULL);
+
+    // Resting levels: encoder contacts open low as in host/sim.cpp, IR receiver high
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2), 0);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3), 0);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 2), 1);
+    for (unsigned col = 0; col < NUM_COLS; ++col) {
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), columnBits[col]), 1);
+    }
+    columnLevels = (1 << NUM_COLS) - 1;
+
+    // Give setup() and the LCD power-on sequence time before the first event
+    avr_cycle_count_t offset = 200000 * CYCLES_PER_US;
+    if (!loadTrace(argv[2], offset)) {
+        return 2;
+    }
+    avr_cycle_count_t end =
+        (numStimuli ? stimuli[numStimuli - 1].cycle : offset) + TAIL_US * CYCLES_PER_US;
+
+    int next = 0;
+    int state = cpu_Running;
+    while (avr->cycle < end && state != cpu_Done && state != cpu_Crashed) {
+        while (next < numStimuli && stimuli[next].cycle <= avr->cycle) {
+            struct stimulus* s = &stimuli[next++];
+            if (s->kind == KEYS) {
+                keys = s->value;
+            } else {
+                avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(s->port), s->bit),
+                    s->value);
+            }
+        }
+        // One instruction per run, so a row change reaches the columns before the next read
+        updateColumns();
+        state = avr_run(avr);
+    }
+    if (state == cpu_Crashed) {
+        fprintf(stderr, "firmware crashed at pc 0x%04x\n", avr->pc);
+        return 2;
+    }
+
+    printf("# cycles at %lu MHz\n", FREQUENCY / 1000000UL);
+    for (int i = 0; i < NUM_SECTIONS; ++i) {
+        const struct section* s = &sections[i];
+        printf("%s n %llu min %llu avg %llu max %llu\n", sectionNames[i],
+            (unsigned long long)s->count, (unsigned long long)s->min,
+            (unsigned long long)(s->count ? s->total / s->count : 0),
+            (unsigned long long)s->max);
+    }
+    if (argc > 3 && !checkBudgets(argv[3])) {
+        return 1;
+    }
+    return 0;
+}